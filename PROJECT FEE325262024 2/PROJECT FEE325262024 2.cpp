@@ -1,273 +1,403 @@
-#include <iostream>
-#include <queue>
-#include <vector>
-#include <random>
-#include <chrono>
-#include <thread>
-#include <iomanip>
-#include <algorithm>
-#include <map>
-
-enum Direction { NORTH = 0, EAST, SOUTH, WEST };
-enum LightState { RED, YELLOW, GREEN };
-enum PedestrianState { DONT_WALK, WALK };
-
-// Vehicle class
-class Vehicle {
-private:
-    int id;
-    bool emergency;
-    std::chrono::system_clock::time_point arrivalTime;
-
-public:
-    Vehicle(int vehicleId, bool isEmergency = false) : id(vehicleId), emergency(isEmergency) {
-        arrivalTime = std::chrono::system_clock::now();
-    }
-
-    int getId() const { return id; }
-    bool isEmergencyVehicle() const { return emergency; }
-
-    int getWaitingTime() const {
-        auto now = std::chrono::system_clock::now();
-        return std::chrono::duration_cast<std::chrono::seconds>(now - arrivalTime).count();
-    }
-};
-
-// Pedestrian signal
-class PedestrianSignal {
-private:
-    PedestrianState state;
-    bool request;
-
-public:
-    PedestrianSignal() : state(DONT_WALK), request(false) {}
-
-    void requestCrossing() { request = true; }
-    void grantCrossing() { state = WALK; request = false; }
-    void endCrossing() { state = DONT_WALK; }
-
-    bool isRequested() const { return request; }
-    PedestrianState getState() const { return state; }
-};
-
-// Traffic lane
-class TrafficLane {
-private:
-    Direction direction;
-    std::queue<Vehicle> vehicles;
-    int trafficDensity;
-
-public:
-    TrafficLane(Direction dir) : direction(dir), trafficDensity(5) {}
-
-    void addVehicle(const Vehicle& vehicle) { vehicles.push(vehicle); }
-    bool hasVehicles() const { return !vehicles.empty(); }
-    int getQueueLength() const { return vehicles.size(); }
-
-    Vehicle processVehicle() {
-        if (vehicles.empty()) throw std::runtime_error("No vehicles to process");
-        Vehicle v = vehicles.front();
-        vehicles.pop();
-        return v;
+#include "traffic_controller.h"
+
+int main(int argc, char* argv[]) {
+    // --seed N reproduces a previous run exactly;
+    // --log-level off|summary|cycle|vehicle controls console output;
+    // --trace FILE records a binary event trace that --replay FILE summarizes;
+    // --approaches N runs a single junction with N legs (3 to 8) instead of a 4-way;
+    // --arrivals N,E,S,W feeds recorded per-approach arrival files instead of random traffic;
+    // --profile rush-hour|FILE draws arrivals from time-of-day demand profiles instead;
+    // --metrics prints phase latency and wait-time percentiles at the end;
+    // --virtual runs on simulated time instead of sleeping between phases;
+    // --cycles N sets how many cycles the cycle-by-cycle simulation runs (20);
+    // --pedestrian WALK,CLEARANCE sets the WALK and flashing DON'T WALK seconds;
+    // --events [seconds] runs the discrete-event engine over a simulated horizon;
+    // --realtime [seconds] runs the deployed control thread on the wall clock, fed by
+    // simulated detector and push-button threads, serving Prometheus metrics over HTTP
+    // at /metrics with --metrics-port PORT, to local scrapers unless --metrics-bind ADDRESS
+    // (0.0.0.0 for every interface);
+    // --grid ROWS COLS [seconds] runs a grid network, in parallel with --threads N;
+    // --scenario FILE [seconds] runs the network a text or precompiled scenario describes, and
+    // --compile-scenario OUT writes its precompiled form instead;
+    // --fleet COUNT [seconds] steps COUNT independent 4-way junctions in the vectorized batch engine;
+    // --corridor JUNCTIONS [seconds] optimizes green-wave offsets on an arterial of that many
+    // junctions on a --cycle SECONDS shared cycle, over --batch SEEDS replicas per candidate;
+    // --batch SEEDS [seconds] runs seeded replicas over the grid given by
+    // --base-green/--yellow/--min-green/--max-green/--density-weight comma-separated lists,
+    // each forked from one --warmup SECONDS checkpoint of its set when given;
+    // --checkpoint FILE saves the state at the end of an --events run, and --restore FILE
+    // resumes one up to the --events horizon, forking new random streams with --seed;
+    // --tune [generations] searches the timing plan that minimizes mean plus p95 delay over
+    // --batch SEEDS replicas, under the --arrivals or --profile demand when given, separately for each
+    // time-of-day period between the --periods SECONDS,... boundaries;
+    // --policy adaptive|fixed|actuated|max-pressure|coordinated picks the signal timing policy,
+    // or a comma-separated list of them to compare in a batch
+    bool virtualTime = false, eventDriven = false, realTime = false;
+    int gridRows = 0, gridCols = 0, approaches = 4, corridorJunctions = 0, cycleSeconds = 90;
+    std::size_t fleetSize = 0;
+    unsigned batchSeeds = 0, firstSeed = 1;
+    std::uint64_t seed = std::random_device{}();
+    LogLevel logLevel = LOG_VEHICLE;
+    std::string tracePath, replayPath;
+    std::vector<std::string> arrivalPaths;
+    std::string profileName;
+    bool recordedArrivals = false, metrics = false;
+    ParameterGrid parameterGrid;
+    unsigned threads = std::thread::hardware_concurrency();
+    long long horizonSeconds = 600, warmupSeconds = 0;
+    int metricsPort = -1, tuneGenerations = 0;
+    std::string metricsBind = "127.0.0.1";
+    std::vector<long long> periodBounds;
+    std::string checkpointPath, restorePath, scenarioPath, compiledScenarioPath;
+    int cycles = 20;
+    PedestrianTiming pedestrianTiming;
+    bool seedGiven = false, horizonGiven = false;
+    auto optionalNumber = [&](int& i) { return i + 1 < argc && std::isdigit(static_cast<unsigned char>(argv[i + 1][0])); };
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--virtual") virtualTime = true;
+        else if (arg == "--events") {
+            eventDriven = true;
+            if (optionalNumber(i)) horizonSeconds = std::stoll(argv[++i]);
+        } else if (arg == "--realtime") {
+            realTime = true;
+            horizonSeconds = 30;
+            if (optionalNumber(i)) horizonSeconds = std::stoll(argv[++i]);
+        } else if (arg == "--grid" && i + 2 < argc) {
+            gridRows = std::stoi(argv[++i]);
+            gridCols = std::stoi(argv[++i]);
+            if (optionalNumber(i)) horizonSeconds = std::stoll(argv[++i]);
+        } else if (arg == "--fleet" && optionalNumber(i)) {
+            fleetSize = std::stoull(argv[++i]);
+            if (optionalNumber(i)) horizonSeconds = std::stoll(argv[++i]);
+        } else if (arg == "--corridor" && optionalNumber(i)) {
+            corridorJunctions = std::stoi(argv[++i]);
+            horizonSeconds = 3600;
+            if (optionalNumber(i)) horizonSeconds = std::stoll(argv[++i]);
+        } else if (arg == "--tune") {
+            tuneGenerations = 12;
+            if (optionalNumber(i)) tuneGenerations = std::stoi(argv[++i]);
+        } else if (arg == "--periods" && i + 1 < argc) {
+            std::stringstream list(argv[++i]);
+            for (std::string item; std::getline(list, item, ',');) periodBounds.push_back(std::stoll(item));
+        } else if (arg == "--cycle" && optionalNumber(i)) {
+            cycleSeconds = std::stoi(argv[++i]);
+        } else if (arg == "--approaches" && optionalNumber(i)) {
+            approaches = std::stoi(argv[++i]);
+        } else if (arg == "--threads" && optionalNumber(i)) {
+            threads = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (arg == "--batch" && optionalNumber(i)) {
+            batchSeeds = static_cast<unsigned>(std::stoul(argv[++i]));
+            if (optionalNumber(i)) horizonSeconds = std::stoll(argv[++i]);
+        } else if (arg == "--log-level" && i + 1 < argc) {
+            std::string level = argv[++i];
+            logLevel = level == "off" ? LOG_OFF : level == "summary" ? LOG_SUMMARY : level == "cycle" ? LOG_CYCLE : LOG_VEHICLE;
+        } else if (arg == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (arg == "--arrivals" && i + 1 < argc) {
+            std::stringstream list(argv[++i]);
+            std::string item;
+            while (std::getline(list, item, ',')) arrivalPaths.push_back(item);
+            recordedArrivals = true;
+        } else if (arg == "--scenario" && i + 1 < argc) {
+            scenarioPath = argv[++i];
+            if ((horizonGiven = optionalNumber(i))) horizonSeconds = std::stoll(argv[++i]);
+        } else if (arg == "--compile-scenario" && i + 1 < argc) {
+            compiledScenarioPath = argv[++i];
+        } else if (arg == "--pedestrian" && i + 1 < argc) {
+            char* end;
+            pedestrianTiming.walkSeconds = static_cast<int>(std::strtol(argv[++i], &end, 10));
+            if (*end == ',') pedestrianTiming.clearanceSeconds = static_cast<int>(std::strtol(end + 1, nullptr, 10));
+        } else if (arg == "--cycles" && optionalNumber(i)) {
+            cycles = std::stoi(argv[++i]);
+        } else if (arg == "--profile" && i + 1 < argc) {
+            profileName = argv[++i];
+        } else if (arg == "--metrics") {
+            metrics = true;
+        } else if (arg == "--metrics-port" && optionalNumber(i)) {
+            metricsPort = std::stoi(argv[++i]);
+        } else if (arg == "--metrics-bind" && i + 1 < argc) {
+            metricsBind = argv[++i];
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (arg == "--seed" && optionalNumber(i)) {
+            seed = std::stoull(argv[++i]);
+            seedGiven = true;
+        } else if (arg == "--warmup" && optionalNumber(i)) {
+            warmupSeconds = std::stoll(argv[++i]);
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            checkpointPath = argv[++i];
+        } else if (arg == "--restore" && i + 1 < argc) {
+            restorePath = argv[++i];
+            eventDriven = true;
+        } else if (arg == "--policy" && i + 1 < argc) {
+            parameterGrid.policies.clear();
+            std::stringstream list(argv[++i]);
+            for (std::string item; std::getline(list, item, ',');) parameterGrid.policies.push_back(parsePolicy(item));
+        } else if (arg == "--first-seed" && optionalNumber(i)) {
+            firstSeed = static_cast<unsigned>(std::stoul(argv[++i]));
+        } else if (i + 1 < argc && (arg == "--base-green" || arg == "--yellow" || arg == "--min-green" || arg == "--max-green" || arg == "--density-weight")) {
+            std::vector<double> values;
+            std::stringstream list(argv[++i]);
+            for (std::string item; std::getline(list, item, ',');) values.push_back(std::stod(item));
+            if (arg == "--density-weight") parameterGrid.densityWeights = values;
+            else {
+                std::vector<int>& target = arg == "--base-green" ? parameterGrid.baseGreenTimes : arg == "--yellow" ? parameterGrid.yellowTimes
+                    : arg == "--min-green" ? parameterGrid.minGreenTimes : parameterGrid.maxGreenTimes;
+                target.assign(values.begin(), values.end());
+            }
+        }
     }
 
-    int getTotalWaitTime() const {
-        int total = 0;
-        std::queue<Vehicle> temp = vehicles;
-        while (!temp.empty()) {
-            total += temp.front().getWaitingTime();
-            temp.pop();
+    Instrumentation::setEnabled(metrics);
+    struct MetricsReport {
+        bool enabled;
+        ~MetricsReport() {
+            if (!enabled) return;
+            Logger::global().flush();
+            Instrumentation::exportText(std::cout);
         }
-        return total;
-    }
+    } metricsReport{ metrics };
 
-    double getAverageWaitTime() const {
-        if (vehicles.empty()) return 0;
-        return static_cast<double>(getTotalWaitTime()) / vehicles.size();
+    if (!replayPath.empty()) {
+        summarizeTrace(TraceReader(replayPath));
+        return 0;
     }
 
-    Direction getDirection() const { return direction; }
-    void setTrafficDensity(int d) { trafficDensity = std::clamp(d, 0, 10); }
-    int getTrafficDensity() const { return trafficDensity; }
-
-    bool hasEmergencyVehicle() const {
-        std::queue<Vehicle> temp = vehicles;
-        while (!temp.empty()) {
-            if (temp.front().isEmergencyVehicle()) return true;
-            temp.pop();
+    std::unique_ptr<TraceWriter> traceWriter;
+    if (!tracePath.empty()) traceWriter = std::make_unique<TraceWriter>(tracePath, approaches);
+    std::unique_ptr<ArrivalSource> arrivalSource;
+    if (recordedArrivals) arrivalSource = std::make_unique<TraceArrivalSource>(arrivalPaths);
+    if (!profileName.empty())
+        arrivalSource = std::make_unique<ProfileArrivalSource>(
+            profileName == "rush-hour" ? DemandProfile::rushHour(approaches) : DemandProfile::load(profileName, approaches), seed);
+
+    if (corridorJunctions > 0) {
+        ThreadPool pool(threads);
+        const int travelSeconds = 30;
+        CorridorOptimizer optimizer(pool, corridorJunctions, std::chrono::seconds(travelSeconds), std::chrono::seconds(horizonSeconds),
+                                    batchSeeds ? batchSeeds : 4, firstSeed);
+        CorridorPlan simultaneous = CorridorPlan::progression(corridorJunctions, cycleSeconds, 0);
+        CorridorPlan progression = CorridorPlan::progression(corridorJunctions, cycleSeconds, travelSeconds);
+        auto wallStart = std::chrono::steady_clock::now();
+        CorridorPlan optimized = optimizer.optimize(progression);
+        double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+        std::vector<CorridorScore> scores = optimizer.evaluate({ simultaneous, progression, optimized });
+        const char* names[] = { "Simultaneous", "Progression", "Optimized" };
+        const CorridorPlan* plans[] = { &simultaneous, &progression, &optimized };
+        std::cout << "\n--- Corridor Coordination (" << corridorJunctions << " junctions, " << cycleSeconds << "s cycle) ---\n";
+        for (int k = 0; k < 3; ++k) {
+            std::cout << names[k] << " offsets";
+            for (int offset : plans[k]->offsets) std::cout << " " << offset;
+            std::cout << ": " << std::fixed << std::setprecision(2) << scores[k].travelTime << "s travel, "
+                << scores[k].stopsPerVehicle << " stops per vehicle over " << scores[k].trips << " corridor trips\n";
         }
-        return false;
+        std::cout << "Optimized in " << std::setprecision(3) << wallSeconds << "s wall time on " << pool.threadCount() << " threads\n";
+        return 0;
     }
-};
-
-// Traffic signal
-class TrafficSignal {
-private:
-    std::vector<LightState> lightStates;
-    int currentGreenDirection;
-    int baseGreenTime, yellowTime, minGreenTime, maxGreenTime;
-
-public:
-    TrafficSignal() : lightStates(4, RED), currentGreenDirection(-1), baseGreenTime(20), yellowTime(3), minGreenTime(10), maxGreenTime(60) {}
 
-    void changeLight(Direction newGreenDir) {
-        if (currentGreenDirection >= 0) lightStates[currentGreenDirection] = RED;
-        lightStates[newGreenDir] = GREEN;
-        currentGreenDirection = newGreenDir;
+    if (tuneGenerations > 0) {
+        ThreadPool pool(threads);
+        std::unique_ptr<RecordedDemand> demand;
+        if (periodBounds.size() < 2) periodBounds = { 0, horizonSeconds };
+        if (arrivalSource)
+            demand = std::make_unique<RecordedDemand>(RecordedDemand::record(*arrivalSource, 4, SimulationClock::time_point(std::chrono::seconds(periodBounds.back()))));
+        TimingTuner tuner(pool, parameterGrid.policies.front(), demand.get(), batchSeeds ? batchSeeds : 4, firstSeed);
+        std::cout << "\n--- Timing Plans (" << policyName(parameterGrid.policies.front()) << ", mean + p95 delay) ---\n";
+        auto wallStart = std::chrono::steady_clock::now();
+        for (std::size_t k = 0; k + 1 < periodBounds.size(); ++k) {
+            TimingPeriod period{ periodBounds[k], periodBounds[k + 1] };
+            std::size_t evaluated = 0;
+            SignalTiming defaults, best = tuner.tune(defaults, period, tuneGenerations, &evaluated);
+            TimingScore was = tuner.evaluate(defaults, period), now = tuner.evaluate(best, period);
+            std::cout << std::fixed << std::setprecision(2) << period.start << "-" << period.end << "s: base " << best.baseGreenTime
+                << "s, yellow " << best.yellowTime << "s, min " << best.minGreenTime << "s, max " << best.maxGreenTime
+                << "s: mean " << now.meanDelay << "s, p95 " << now.p95Delay << "s (default plan " << was.meanDelay << "s, "
+                << was.p95Delay << "s) over " << now.vehicles << " vehicles, " << evaluated << " plans tried\n";
+        }
+        double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+        std::cout << "Tuned in " << std::setprecision(3) << wallSeconds << "s wall time on " << pool.threadCount() << " threads\n";
+        return 0;
     }
 
-    void setYellow() {
-        if (currentGreenDirection >= 0) lightStates[currentGreenDirection] = YELLOW;
+    if (batchSeeds > 0) {
+        ThreadPool pool(threads);
+        BatchRunner runner(pool, std::chrono::seconds(horizonSeconds), std::chrono::seconds(warmupSeconds));
+        BatchRunner::displayResults(runner.run(parameterGrid.expand(), firstSeed, batchSeeds));
+        return 0;
     }
 
-    LightState getLightState(Direction dir) const { return lightStates[dir]; }
-    int getCurrentGreenDirection() const { return currentGreenDirection; }
-    int getYellowTime() const { return yellowTime; }
-
-    int calculateAdaptiveGreenTime(const TrafficLane& lane) const {
-        int time = baseGreenTime + lane.getQueueLength() * 2 + lane.getTrafficDensity() * 2;
-        return std::clamp(time, minGreenTime, maxGreenTime);
+    if (fleetSize > 0) {
+        ThreadPool pool(threads);
+        std::cout << "Seed: " << seed << "\n";
+        IntersectionBatch fleet(fleetSize, seed);
+        auto wallStart = std::chrono::steady_clock::now();
+        fleet.runUntil(SimulationClock::time_point(std::chrono::seconds(horizonSeconds)), pool);
+        double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+        fleet.displaySummary();
+        std::cout << "Simulated " << horizonSeconds << "s in " << std::fixed << std::setprecision(3) << wallSeconds
+            << "s wall time on " << pool.threadCount() << " threads\n";
+        return 0;
     }
-};
-
-// Intersection Controller
-class IntersectionController {
-private:
-    std::vector<TrafficLane> lanes;
-    std::map<Direction, PedestrianSignal> pedestrianSignals;
-    TrafficSignal signal;
-    std::mt19937 rng;
-    int vehicleCounter, totalVehiclesProcessed, totalWaitTime, cycleCounter;
 
-public:
-    IntersectionController() : vehicleCounter(0), totalVehiclesProcessed(0), totalWaitTime(0), cycleCounter(0) {
-        for (int i = 0; i < 4; ++i) {
-            lanes.emplace_back(static_cast<Direction>(i));
-            pedestrianSignals[static_cast<Direction>(i)] = PedestrianSignal();
+    if (!scenarioPath.empty()) {
+        auto loadStart = std::chrono::steady_clock::now();
+        Scenario scenario = Scenario::load(scenarioPath);
+        if (seedGiven) scenario.seed = seed;
+        if (horizonGiven) scenario.horizon = std::chrono::seconds(horizonSeconds);
+        if (!compiledScenarioPath.empty()) {
+            scenario.compile(compiledScenarioPath);
+            std::cout << "Compiled " << scenario.intersections.size() << " intersections and " << scenario.links.size()
+                << " links into " << compiledScenarioPath << "\n";
+            return 0;
         }
-        rng.seed(std::random_device{}());
+        RoadNetwork network = scenario.build();
+        double loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count();
+        ThreadPool pool(threads);
+        std::cout << "Seed: " << scenario.seed << "\nLoaded " << scenarioPath << " in " << std::fixed << std::setprecision(3)
+            << loadSeconds * 1e3 << "ms\n";
+        auto wallStart = std::chrono::steady_clock::now();
+        network.runUntil(SimulationClock::time_point(scenario.horizon), pool);
+        double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+        network.displaySummary();
+        std::cout << "Simulated " << std::chrono::duration<double>(scenario.horizon).count() << "s in " << std::setprecision(3) << wallSeconds
+            << "s wall time on " << pool.threadCount() << " threads\n";
+        return 0;
     }
 
-    void generateTraffic() {
-        std::uniform_int_distribution<int> arrivalDist(0, 10);
-        std::uniform_int_distribution<int> densityChange(0, 20);
-        std::uniform_int_distribution<int> emergencyChance(0, 20);
-
-        for (auto& lane : lanes) {
-            if (densityChange(rng) == 0) lane.setTrafficDensity(rng() % 11);
-            int arrivalThreshold = 10 - lane.getTrafficDensity();
-            if (arrivalDist(rng) >= arrivalThreshold) {
-                bool isEmergency = (emergencyChance(rng) == 0);
-                lane.addVehicle(Vehicle(++vehicleCounter, isEmergency));
-            }
-        }
-
-        // Simulate random pedestrian requests
-        std::uniform_int_distribution<int> pedChance(0, 15);
-        for (auto& [dir, signal] : pedestrianSignals) {
-            if (pedChance(rng) == 0) signal.requestCrossing();
-        }
+    if (gridRows > 0 && gridCols > 0) {
+        ThreadPool pool(threads);
+        std::cout << "Seed: " << seed << "\n";
+        RoadNetwork network = RoadNetwork::grid(gridRows, gridCols, seed);
+        network.setSignalPolicy(parameterGrid.policies.front());
+        auto wallStart = std::chrono::steady_clock::now();
+        network.runUntil(SimulationClock::time_point(std::chrono::seconds(horizonSeconds)), pool);
+        double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+        network.displaySummary();
+        std::cout << "Simulated " << horizonSeconds << "s in " << std::fixed << std::setprecision(3) << wallSeconds
+            << "s wall time on " << pool.threadCount() << " threads\n";
+        return 0;
     }
 
-    void processCycle() {
-        ++cycleCounter;
-        std::cout << "\n=== Traffic Cycle #" << cycleCounter << " ===\n";
-        generateTraffic();
-        displayQueueStatus();
-
-        Direction nextDir = findNextGreenDirection();
-        if (signal.getCurrentGreenDirection() >= 0) {
-            signal.setYellow();
-            std::cout << "Yellow light for " << directionToString(static_cast<Direction>(signal.getCurrentGreenDirection())) << "\n";
-            std::this_thread::sleep_for(std::chrono::seconds(signal.getYellowTime()));
+    if (realTime) {
+        RealTimeController<IntersectionController> rt(seed);
+        IntersectionController& controller = rt.getController();
+        controller.setLogLevel(logLevel);
+        controller.setSignalPolicy(parameterGrid.policies.front());
+        SpscQueue<SensorEvent>& detectors = rt.addSensor();
+        SpscQueue<SensorEvent>& buttons = rt.addSensor();
+        ControllerMetrics live(controller.getLayout().approaches(), controller.getLayout().phaseCount());
+        controller.setMetrics(&live);
+        std::unique_ptr<MetricsServer> metricsServer;
+        if (metricsPort >= 0) {
+            metricsServer = std::make_unique<MetricsServer>(metricsPort, [&](std::ostream& os) {
+                live.exportPrometheus(os);
+                if (Instrumentation::enabled()) Instrumentation::exportPrometheus(os);
+            }, metricsBind);
         }
-
-        signal.changeLight(nextDir);
-        int greenTime = signal.calculateAdaptiveGreenTime(lanes[nextDir]);
-
-        std::cout << "Green light for " << directionToString(nextDir) << " (" << greenTime << "s)\n";
-
-        if (pedestrianSignals[nextDir].isRequested()) {
-            pedestrianSignals[nextDir].grantCrossing();
-            std::cout << "Pedestrians WALK on " << directionToString(nextDir) << "\n";
-            std::this_thread::sleep_for(std::chrono::seconds(3));
-            pedestrianSignals[nextDir].endCrossing();
-        }
-
-        processVehicles(nextDir, greenTime);
-        displayStats();
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
-    }
-
-    Direction findNextGreenDirection() {
-        for (const auto& lane : lanes) {
-            if (lane.hasEmergencyVehicle()) {
-                std::cout << "Emergency vehicle detected on " << directionToString(lane.getDirection()) << "!\n";
-                return lane.getDirection();
+        std::cout << "Seed: " << seed << "\n";
+        if (metricsServer) std::cout << "Serving metrics on " << metricsBind << " port " << metricsServer->port() << "\n";
+        rt.start();
+
+        // Stand-ins for the loop detectors and push buttons, each on its own thread
+        std::atomic<bool> sensing{ true };
+        auto sensor = [&](SpscQueue<SensorEvent>& queue, std::uint64_t stream, bool pedestrian) {
+            RandomStream rng(seed, stream);
+            while (sensing.load(std::memory_order_relaxed)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(pedestrian ? 2000 + rng.below(6000) : 200 + rng.below(1000)));
+                int approach = static_cast<int>(rng.below(4));
+                SensorEvent e = pedestrian ? SensorEvent{ SENSOR_PEDESTRIAN, approach, 0, false }
+                                           : SensorEvent{ SENSOR_VEHICLE, approach, -1, rng.oneIn(30) };
+                while (!queue.tryPush(e) && sensing.load(std::memory_order_relaxed)) std::this_thread::yield();
             }
-        }
-
-        double maxScore = -1;
-        Direction best = NORTH;
-        for (const auto& lane : lanes) {
-            if (lane.hasVehicles()) {
-                double score = lane.getQueueLength() * lane.getAverageWaitTime() * (1 + lane.getTrafficDensity() / 10.0);
-                if (score > maxScore) {
-                    maxScore = score;
-                    best = lane.getDirection();
-                }
+        };
+        std::thread detectorThread(sensor, std::ref(detectors), 100, false);
+        std::thread buttonThread(sensor, std::ref(buttons), 101, true);
+        // A dashboard polling the published signal state, never blocking the control thread
+        long long polls = 0, changes = 0;
+        std::thread monitorThread([&] {
+            SignalSnapshot last;
+            while (sensing.load(std::memory_order_relaxed)) {
+                SignalSnapshot current = rt.snapshot();
+                ++polls;
+                if (std::memcmp(&current, &last, sizeof current)) ++changes;
+                last = current;
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
             }
-        }
-        return best;
-    }
-
-    void processVehicles(Direction dir, int greenTime) {
-        int canPass = greenTime / 2, passed = 0;
-        while (passed < canPass && lanes[dir].hasVehicles()) {
-            Vehicle v = lanes[dir].processVehicle();
-            std::cout << "Vehicle #" << v.getId() << (v.isEmergencyVehicle() ? " (EMERGENCY)" : "")
-                << " passed from " << directionToString(dir)
-                << " after waiting " << v.getWaitingTime() << "s\n";
-            totalVehiclesProcessed++;
-            totalWaitTime += v.getWaitingTime();
-            passed++;
-        }
-        std::cout << "Total vehicles passed: " << passed << "\n";
+        });
+        std::this_thread::sleep_for(std::chrono::seconds(horizonSeconds));
+        sensing = false;
+        detectorThread.join();
+        buttonThread.join();
+        monitorThread.join();
+        rt.stop();
+        metricsServer.reset();
+
+        if (logLevel >= LOG_SUMMARY) controller.displayStats();
+        Logger::global().flush();
+        std::cout << std::fixed << std::setprecision(3) << "Sensor events: " << rt.getSensorEventCount()
+            << ", Max deadline lateness: " << std::chrono::duration<double, std::milli>(rt.getMaxLateness()).count() << "ms\n"
+            << "Emergency preemptions: " << controller.getPreemptionCount() << ", Max preemption latency: "
+            << std::chrono::duration<double>(controller.getMaxPreemptionLatency()).count() << "s\n"
+            << "Monitor polls: " << polls << ", Signal changes seen: " << changes << "\n";
+        return 0;
     }
 
-    void displayQueueStatus() const {
-        std::cout << "\n--- Queue Status ---\n";
-        for (const auto& lane : lanes) {
-            Direction d = lane.getDirection();
-            std::cout << directionToString(d) << ": " << lane.getQueueLength()
-                << " vehicles, Avg Wait: " << std::fixed << std::setprecision(1)
-                << lane.getAverageWaitTime() << "s, Density: " << lane.getTrafficDensity()
-                << ", Ped Request: " << (pedestrianSignals.at(d).isRequested() ? "Yes" : "No") << "\n";
-        }
-    }
+    RealTimeClock realClock;
+    VirtualClock virtualClock;
+    SimulationClock& clock = eventDriven || virtualTime ? static_cast<SimulationClock&>(virtualClock) : realClock;
 
-    void displayStats() const {
-        std::cout << "\n--- Statistics ---\n";
-        std::cout << "Total Vehicles Processed: " << totalVehiclesProcessed << "\n";
-        if (totalVehiclesProcessed)
-            std::cout << "Average Wait Time: " << std::fixed << std::setprecision(2)
-            << (double)totalWaitTime / totalVehiclesProcessed << "s\n";
+    // A restored run takes the junction size, policy and seed from its checkpoint
+    std::unique_ptr<MappedFile> restoreFile;
+    if (!restorePath.empty()) {
+        restoreFile = std::make_unique<MappedFile>(restorePath);
+        approaches = CheckpointReader(restoreFile->data(), restoreFile->size()).approaches();
     }
 
-    static std::string directionToString(Direction d) {
-        switch (d) {
-        case NORTH: return "North";
-        case EAST: return "East";
-        case SOUTH: return "South";
-        case WEST: return "West";
-        default: return "Unknown";
+    // Common junction sizes get their compile-time layout, anything else the runtime one
+    auto run = [&](auto& controller) {
+        controller.setLogLevel(logLevel);
+        controller.setPedestrianTiming(pedestrianTiming);
+        controller.setSignalPolicy(parameterGrid.policies.front());
+        controller.setTraceWriter(traceWriter.get());
+        controller.setArrivalSource(arrivalSource.get());
+        if (eventDriven) {
+            EventScheduler scheduler(virtualClock);
+            if (restoreFile) {
+                CheckpointReader in(restoreFile->data(), restoreFile->size());
+                scheduler.restoreState(in);
+                controller.restoreState(in);
+                if (seedGiven) controller.reseed(seed);
+            } else {
+                controller.start(scheduler);
+            }
+            std::cout << "Seed: " << controller.getSeed() << "\n";
+            scheduler.runUntil(SimulationClock::time_point(std::chrono::seconds(horizonSeconds)),
+                [&](const Event& e) { controller.handleEvent(e, scheduler); });
+            if (!checkpointPath.empty()) {
+                CheckpointWriter out(controller.getLayout().approaches());
+                scheduler.saveState(out);
+                controller.saveState(out);
+                out.save(checkpointPath);
+            }
+        } else {
+            std::cout << "Seed: " << seed << "\n";
+            for (int i = 0; i < cycles; ++i) controller.processCycle();
         }
+        if (logLevel >= LOG_SUMMARY) controller.displayStats();
+        Logger::global().flush();
+        if (traceWriter) traceWriter->close();
+    };
+    if (approaches == 4) {
+        IntersectionController controller(clock, seed);
+        run(controller);
+    } else if (approaches == 3) {
+        TJunctionController controller(clock, seed);
+        run(controller);
+    } else {
+        DynamicIntersectionController controller(clock, seed, JunctionLayout<dynamicApproaches>(approaches));
+        run(controller);
     }
-};
-
-int main() {
-    IntersectionController controller;
-    int cycles = 20;
-    for (int i = 0; i < cycles; ++i) controller.processCycle();
     return 0;
 }
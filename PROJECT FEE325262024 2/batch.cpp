@@ -0,0 +1,314 @@
+// Batched intersections, parameter grids and the replica runner
+
+#include "traffic_controller.h"
+
+std::uint32_t IntersectionBatch::hash32(std::uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7FEB352Du;
+    x ^= x >> 15;
+    x *= 0x846CA68Bu;
+    x ^= x >> 16;
+    return x;
+}
+
+std::uint32_t IntersectionBatch::draw(std::uint32_t stepKey, std::uint32_t junction, int stream) {
+    return hash32(stepKey ^ (junction * 0x85EBCA6Bu + static_cast<std::uint32_t>(stream) * 0xC2B2AE35u));
+}
+
+std::int32_t IntersectionBatch::select(bool c, std::int32_t a, std::int32_t b) {
+    std::int32_t mask = -static_cast<std::int32_t>(c);
+    return (a & mask) | (b & ~mask);
+}
+
+std::int32_t IntersectionBatch::orderedBits(float f) {
+    std::int32_t bits;
+    std::memcpy(&bits, &f, sizeof bits);
+    return bits ^ ((bits >> 31) & 0x7FFFFFFF);
+}
+
+void IntersectionBatch::stepBlock(Block& s, std::uint32_t first, std::uint32_t stepKey) const {
+    constexpr std::size_t n = blockJunctions;
+
+    // Traffic: the queued vehicles wait another second, then this second's arrivals join
+    for (int m = 0; m < movements; ++m) {
+        const std::int32_t* d = s.density[Layout::approachOf(m)];
+        const std::int32_t perDensity = arrivalPerDensity[Layout::turnOf(m)];
+        for (std::size_t k = 0; k < n; ++k) {
+            s.waiting[m][k] += static_cast<float>(s.queue[m][k]);
+            s.queue[m][k] += static_cast<std::int32_t>(draw(stepKey, first + static_cast<std::uint32_t>(k), m) >> 1) < (d[k] + 1) * perDensity;
+        }
+    }
+    for (int a = 0; a < approaches; ++a) {
+        for (std::size_t k = 0; k < n; ++k) {
+            std::uint32_t r = draw(stepKey, first + static_cast<std::uint32_t>(k), movements + a);
+            std::int32_t reroll = static_cast<std::int32_t>((r & 0xFFFFu) * 11u >> 16);
+            s.density[a][k] = select(r >> 16 < densityRerollPer65536, reroll, s.density[a][k]);
+        }
+    }
+
+    // Discharge: one vehicle per green movement every saturation headway, taking its
+    // average share of the lane's queued vehicle-seconds
+    for (std::size_t k = 0; k < n; ++k) {
+        s.headwayTick[k] = s.greenElapsed[k] % headwaySeconds == 0;
+        s.discharged[k] = 0;
+    }
+    for (int m = 0; m < movements; ++m) {
+        for (std::size_t k = 0; k < n; ++k) {
+            std::int32_t q = s.queue[m][k];
+            std::int32_t departs = (s.greenMask[k] >> m & 1) & s.headwayTick[k] & (q > 0);
+            float share = static_cast<float>(departs) * (s.waiting[m][k] / static_cast<float>(q + (q == 0)));
+            s.waiting[m][k] -= share;
+            s.queue[m][k] = q - departs;
+            s.processed[k] += departs;
+            s.discharged[k] += share;
+        }
+    }
+    for (std::size_t k = 0; k < n; ++k) s.waited[k] += s.discharged[k];
+
+    // Cached lane scores: queue * average wait * (1 + weight * density) is the queued
+    // vehicle-seconds times the density factor
+    for (int m = 0; m < movements; ++m) {
+        const std::int32_t* d = s.density[Layout::approachOf(m)];
+        for (std::size_t k = 0; k < n; ++k) s.score[m][k] = s.waiting[m][k] * (1.0f + densityWeight * static_cast<float>(d[k]));
+    }
+
+    const std::int32_t noScore = orderedBits(-1.0f), ineligible = orderedBits(-2.0f);
+    for (std::size_t k = 0; k < n; ++k) {
+        s.servedQueue[k] = s.totalQueue[k] = 0;
+        s.bestScore[k] = noScore;
+        s.target[k] = 0;
+    }
+    for (int m = 0; m < movements; ++m) {
+        for (std::size_t k = 0; k < n; ++k) {
+            s.servedQueue[k] += (s.greenMask[k] >> m & 1) * s.queue[m][k];
+            s.totalQueue[k] += s.queue[m][k];
+        }
+    }
+
+    // Next phase: the highest phase score among phases with a vehicle queued
+    for (int p = 0; p < phases; ++p) {
+        MovementMask served = Layout::phase(p).movements;
+        for (std::size_t k = 0; k < n; ++k) {
+            s.phaseScore[k] = 0;
+            s.phaseQueue[k] = 0;
+        }
+        for (int m = 0; m < movements; ++m) {
+            if (!(served >> m & 1)) continue;
+            for (std::size_t k = 0; k < n; ++k) {
+                s.phaseScore[k] += s.score[m][k];
+                s.phaseQueue[k] += s.queue[m][k];
+            }
+        }
+        for (std::size_t k = 0; k < n; ++k) {
+            std::int32_t candidate = select(s.phaseQueue[k] > 0, orderedBits(s.phaseScore[k]), ineligible);
+            s.target[k] = select(candidate > s.bestScore[k], p, s.target[k]);
+            s.bestScore[k] = std::max(candidate, s.bestScore[k]);
+        }
+    }
+
+    // Green time for the phase that goes green next: a yellow's pending phase,
+    // otherwise the one just chosen, sized for its critical lane
+    for (std::size_t k = 0; k < n; ++k) {
+        s.target[k] = select(s.stage[k] == STAGE_YELLOW, s.pendingPhase[k], s.target[k]);
+        s.critical[k] = -1;
+        s.criticalDensity[k] = 0;
+        s.targetMask[k] = 0;
+    }
+    for (int p = 0; p < phases; ++p) {
+        const std::int32_t served = static_cast<std::int32_t>(Layout::phase(p).movements);
+        for (std::size_t k = 0; k < n; ++k) s.targetMask[k] = select(s.target[k] == p, served, s.targetMask[k]);
+    }
+    for (int m = 0; m < movements; ++m) {
+        const std::int32_t* d = s.density[Layout::approachOf(m)];
+        const std::int32_t bit = 1 << m;
+        for (std::size_t k = 0; k < n; ++k) {
+            bool longer = ((s.targetMask[k] & bit) != 0) & (s.queue[m][k] > s.critical[k]);
+            s.critical[k] = select(longer, s.queue[m][k], s.critical[k]);
+            s.criticalDensity[k] = select(longer, d[k], s.criticalDensity[k]);
+        }
+    }
+
+    // Signal state machine
+    const std::int32_t base = timing.baseGreenTime, minGreen = timing.minGreenTime, yellow = timing.yellowTime;
+    const std::int32_t maxGreen = std::max(timing.minGreenTime, timing.maxGreenTime);
+    for (std::size_t k = 0; k < n; ++k) {
+        std::int32_t greenTime = std::clamp(base + 2 * s.critical[k] + 2 * s.criticalDensity[k], minGreen, maxGreen);
+        bool inGreen = s.stage[k] == STAGE_GREEN;
+        std::int32_t timer = s.timer[k] - 1;
+
+        // A green ends when its time is up or its queues clear, unless nothing waits anywhere
+        bool decide = inGreen & ((timer <= 0) | (s.servedQueue[k] == 0)) & (s.totalQueue[k] > 0);
+        bool needsYellow = decide & ((s.greenMask[k] & ~s.targetMask[k]) != 0);
+        bool switchNow = (decide & !needsYellow) | (!inGreen & (timer <= 0));
+
+        s.pendingPhase[k] = select(needsYellow, s.target[k], s.pendingPhase[k]);
+        s.stage[k] = select(needsYellow, STAGE_YELLOW, select(switchNow, STAGE_GREEN, s.stage[k]));
+        s.phase[k] = select(switchNow, s.target[k], s.phase[k]);
+        s.greenMask[k] = select(needsYellow, 0, select(switchNow, s.targetMask[k], s.greenMask[k]));
+        s.timer[k] = select(needsYellow, yellow, select(switchNow, greenTime, timer));
+        s.greenElapsed[k] = select(switchNow, 0, s.greenElapsed[k] + inGreen);
+    }
+}
+
+void IntersectionBatch::runBlock(std::size_t block, long long fromSecond, long long seconds) {
+    std::uint32_t first = static_cast<std::uint32_t>(block * blockJunctions);
+    for (long long t = 0; t < seconds; ++t)
+        stepBlock(blocks[block], first, hash32(seedKey ^ hash32(static_cast<std::uint32_t>(fromSecond + t) * 0x9E3779B9u)));
+}
+
+IntersectionBatch::IntersectionBatch(std::size_t intersections, std::uint64_t seed, const SignalTiming& signalTiming,
+                           double scoreDensityWeight)
+    : count(intersections), seedKey(static_cast<std::uint32_t>(RandomStream::deriveSeed(seed, 0))), elapsedSeconds(0),
+      timing(signalTiming), densityWeight(static_cast<float>(scoreDensityWeight)),
+      blocks((intersections + blockJunctions - 1) / blockJunctions) {
+    for (Block& s : blocks) {
+        std::memset(&s, 0, sizeof s);
+        for (auto& row : s.density) std::fill(std::begin(row), std::end(row), 5);
+        std::fill(std::begin(s.stage), std::end(s.stage), static_cast<std::int32_t>(STAGE_YELLOW));
+        std::fill(std::begin(s.timer), std::end(s.timer), 1);
+    }
+}
+
+void IntersectionBatch::runUntil(SimulationClock::time_point end, ThreadPool& pool) {
+    long long seconds = std::chrono::duration_cast<std::chrono::seconds>(end.time_since_epoch()).count() - elapsedSeconds;
+    if (seconds <= 0) return;
+    pool.parallelFor(blocks.size(), [&](std::size_t b) { runBlock(b, elapsedSeconds, seconds); });
+    elapsedSeconds += seconds;
+}
+
+long long IntersectionBatch::getTotalVehiclesProcessed() const {
+    return static_cast<long long>(sumOver([](const Block& s, std::size_t k) { return s.processed[k]; }));
+}
+
+long long IntersectionBatch::getQueuedVehicles() const {
+    return static_cast<long long>(sumOver([](const Block& s, std::size_t k) {
+        std::int32_t total = 0;
+        for (int m = 0; m < movements; ++m) total += s.queue[m][k];
+        return total;
+    }));
+}
+
+double IntersectionBatch::getAverageWaitTime() const {
+    long long vehicles = getTotalVehiclesProcessed();
+    return vehicles ? sumOver([](const Block& s, std::size_t k) { return s.waited[k]; }) / vehicles : 0;
+}
+
+void IntersectionBatch::displaySummary() const {
+    std::cout << "\n--- Batch Engine Statistics ---\n";
+    std::cout << "Intersections: " << count << ", Vehicles Processed: " << getTotalVehiclesProcessed()
+        << ", Queued: " << getQueuedVehicles() << "\n";
+    std::cout << "Average Wait Time: " << std::fixed << std::setprecision(2) << getAverageWaitTime() << "s\n";
+}
+
+std::vector<ReplicaParameters> ParameterGrid::expand() const {
+    std::vector<ReplicaParameters> out;
+    for (const SignalPolicy& policy : policies)
+        for (int base : baseGreenTimes)
+            for (int yellow : yellowTimes)
+                for (int minGreen : minGreenTimes)
+                    for (int maxGreen : maxGreenTimes) {
+                        if (minGreen > maxGreen) continue;
+                        ReplicaParameters p;
+                        p.timing = SignalTiming{ base, yellow, minGreen, maxGreen };
+                        p.policy = policy;
+                        if (!std::holds_alternative<AdaptivePolicy>(policy)) {
+                            out.push_back(p);
+                            continue;
+                        }
+                        for (double weight : densityWeights) {
+                            std::get<AdaptivePolicy>(p.policy).densityWeight = weight;
+                            out.push_back(p);
+                        }
+                    }
+    return out;
+}
+
+SampleSummary SampleSummary::of(const std::vector<double>& samples) {
+    static const double t975[] = { 12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                   2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                   2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+    std::size_t n = samples.size();
+    if (n == 0) return { 0, 0 };
+    double mean = 0;
+    for (double x : samples) mean += x;
+    mean /= n;
+    if (n == 1) return { mean, 0 };
+    double var = 0;
+    for (double x : samples) var += (x - mean) * (x - mean);
+    var /= (n - 1);
+    double t = n - 1 <= 30 ? t975[n - 2] : 1.960;
+    return { mean, t * std::sqrt(var / n) };
+}
+
+std::vector<unsigned char> BatchRunner::warmUp(const ReplicaParameters& params, std::uint64_t seed) const {
+    VirtualClock clock;
+    EventScheduler scheduler(clock);
+    IntersectionController controller(clock, seed);
+    controller.setLogLevel(LOG_OFF);
+    controller.setSignalTiming(params.timing);
+    controller.setSignalPolicy(params.policy);
+    controller.start(scheduler);
+    scheduler.runUntil(SimulationClock::time_point(warmup), [&](const Event& e) { controller.handleEvent(e, scheduler); });
+    CheckpointWriter out(controller.getLayout().approaches());
+    scheduler.saveState(out);
+    controller.saveState(out);
+    return out.bytes();
+}
+
+ReplicaResult BatchRunner::runReplica(const ReplicaParameters& params, std::uint64_t seed, const std::vector<unsigned char>* warmState) const {
+    VirtualClock clock;
+    EventScheduler scheduler(clock);
+    IntersectionController controller(clock, seed);
+    controller.setLogLevel(LOG_OFF);
+    if (warmState) {
+        CheckpointReader in(*warmState);
+        scheduler.restoreState(in);
+        controller.restoreState(in);
+        controller.reseed(seed);
+        controller.resetStatistics();
+    } else {
+        controller.setSignalTiming(params.timing);
+        controller.setSignalPolicy(params.policy);
+        controller.start(scheduler);
+    }
+    scheduler.runUntil(clock.now() + horizon, [&](const Event& e) { controller.handleEvent(e, scheduler); });
+
+    double hours = std::chrono::duration<double>(horizon).count() / 3600.0;
+    return { controller.getAverageWaitTime(), controller.getTotalVehiclesProcessed() / hours };
+}
+
+std::vector<BatchResult> BatchRunner::run(const std::vector<ReplicaParameters>& sets, unsigned firstSeed, unsigned seedCount) const {
+    std::vector<std::vector<unsigned char>> warmStates(warmup > SimulationClock::duration::zero() ? sets.size() : 0);
+    pool.parallelFor(warmStates.size(), [&](std::size_t s) { warmStates[s] = warmUp(sets[s], RandomStream::deriveSeed(firstSeed, 0)); });
+
+    std::vector<ReplicaResult> replicas(sets.size() * seedCount);
+    pool.parallelFor(replicas.size(), [&](std::size_t i) {
+        std::size_t s = i / seedCount;
+        replicas[i] = runReplica(sets[s], firstSeed + static_cast<unsigned>(i % seedCount), warmStates.empty() ? nullptr : &warmStates[s]);
+    });
+
+    std::vector<BatchResult> results;
+    for (std::size_t s = 0; s < sets.size(); ++s) {
+        std::vector<double> waits, throughputs;
+        for (unsigned k = 0; k < seedCount; ++k) {
+            waits.push_back(replicas[s * seedCount + k].averageWait);
+            throughputs.push_back(replicas[s * seedCount + k].throughputPerHour);
+        }
+        results.push_back({ sets[s], SampleSummary::of(waits), SampleSummary::of(throughputs) });
+    }
+    return results;
+}
+
+void BatchRunner::displayResults(const std::vector<BatchResult>& results) {
+    std::cout << "\n--- Batch Results (mean +/- 95% CI) ---\n";
+    for (const auto& r : results) {
+        std::cout << policyName(r.parameters.policy) << ", base " << r.parameters.timing.baseGreenTime << "s, yellow "
+            << r.parameters.timing.yellowTime << "s, min "
+            << r.parameters.timing.minGreenTime << "s, max " << r.parameters.timing.maxGreenTime << "s"
+            << std::fixed << std::setprecision(2);
+        if (const auto* adaptive = std::get_if<AdaptivePolicy>(&r.parameters.policy))
+            std::cout << ", density weight " << adaptive->densityWeight;
+        std::cout << ": Avg Wait " << r.averageWait.mean << " +/- " << r.averageWait.halfWidth
+            << "s, Throughput " << std::setprecision(1) << r.throughput.mean << " +/- " << r.throughput.halfWidth << " veh/h\n";
+    }
+}
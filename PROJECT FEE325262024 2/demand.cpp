@@ -0,0 +1,112 @@
+// Demand profiles and recorded demand as arrival sources
+
+#include "traffic_controller.h"
+
+DemandProfile::DemandProfile(std::vector<Step> profileSteps)
+    : steps(std::move(profileSteps)) {
+    if (steps.empty() || steps.front().start != 0) throw std::invalid_argument("A demand profile starts at midnight");
+    for (std::size_t i = 0; i < steps.size(); ++i) {
+        if (steps[i].vehiclesPerHour < 0) throw std::invalid_argument("Arrival rates cannot be negative");
+        if (steps[i].start >= daySeconds || (i && steps[i].start <= steps[i - 1].start))
+            throw std::invalid_argument("Demand profile steps must increase within one day");
+    }
+}
+
+std::vector<DemandProfile> DemandProfile::rushHour(int approaches) {
+    std::vector<DemandProfile> profiles;
+    for (int a = 0; a < approaches; ++a) {
+        bool major = a % 2 == 0;
+        profiles.push_back(DemandProfile({ { 0, 40 }, { 6 * 3600, 200 }, { 7 * 3600, major ? 720.0 : 300.0 }, { 9 * 3600, 260 },
+                                           { 16 * 3600, major ? 600.0 : 450.0 }, { 18 * 3600, 240 }, { 21 * 3600, 100 } }));
+    }
+    return profiles;
+}
+
+std::vector<DemandProfile> DemandProfile::load(const std::string& path, int approaches) {
+    ChunkedFileReader reader(path);
+    std::vector<std::vector<Step>> columns(approaches);
+    const char* text;
+    std::size_t n;
+    while (reader.readLine(text, n)) {
+        std::string line(text, n);
+        char* end;
+        double start = std::strtod(line.c_str(), &end);
+        if (end == line.c_str()) continue;    // header or blank line
+        std::vector<double> rates;
+        while (*end == ',') rates.push_back(std::strtod(end + 1, &end));
+        if (rates.size() != 1 && rates.size() != columns.size())
+            throw std::runtime_error("Demand profile " + path + " needs 1 or " + std::to_string(approaches) + " rate columns");
+        for (int a = 0; a < approaches; ++a) columns[a].push_back({ start, rates[rates.size() == 1 ? 0 : a] });
+    }
+    std::vector<DemandProfile> profiles;
+    for (auto& column : columns) profiles.emplace_back(std::move(column));
+    return profiles;
+}
+
+double ProfileArrivalSource::timeAt(const Lane& lane, double expected) {
+    double days = std::floor(expected / lane.expectedPerDay);
+    double within = expected - days * lane.expectedPerDay;
+    std::size_t i = std::upper_bound(lane.expectedAt.begin(), lane.expectedAt.end(), within) - lane.expectedAt.begin() - 1;
+    return days * DemandProfile::daySeconds + lane.profile.steps[i].start +
+        (within - lane.expectedAt[i]) * 3600 / lane.profile.steps[i].vehiclesPerHour;
+}
+
+double ProfileArrivalSource::expectedBy(const Lane& lane, double seconds) {
+    double days = std::floor(seconds / DemandProfile::daySeconds), within = seconds - days * DemandProfile::daySeconds;
+    std::size_t i = std::upper_bound(lane.profile.steps.begin(), lane.profile.steps.end(), within,
+                                     [](double x, const DemandProfile::Step& s) { return x < s.start; }) - lane.profile.steps.begin() - 1;
+    return days * lane.expectedPerDay + lane.expectedAt[i] + (within - lane.profile.steps[i].start) * lane.profile.steps[i].vehiclesPerHour / 3600;
+}
+
+void ProfileArrivalSource::refill(Lane& lane) {
+    double gaps[batchSize];
+    for (double& g : gaps) g = lane.stream.uniform();
+    for (double& g : gaps) g = -std::log1p(-g);
+    lane.times.resize(batchSize);
+    lane.emergencies.resize(batchSize);
+    for (std::size_t i = 0; i < batchSize; ++i) {
+        lane.expected += gaps[i];
+        lane.times[i] = SimulationClock::time_point(std::chrono::duration_cast<SimulationClock::duration>(
+            std::chrono::duration<double>(timeAt(lane, lane.expected))));
+        lane.emergencies[i] = lane.stream.oneIn(21);
+    }
+    lane.next = 0;
+}
+
+ProfileArrivalSource::ProfileArrivalSource(std::vector<DemandProfile> profiles, std::uint64_t seed, SimulationClock::time_point start)
+    : lanes(profiles.size()) {
+    double from = std::chrono::duration<double>(start.time_since_epoch()).count();
+    for (std::size_t a = 0; a < lanes.size(); ++a) {
+        Lane& lane = lanes[a];
+        lane.profile = std::move(profiles[a]);
+        for (std::size_t i = 0; i < lane.profile.steps.size(); ++i) {
+            lane.expectedAt.push_back(lane.expectedPerDay);
+            lane.expectedPerDay += (lane.profile.stepEnd(i) - lane.profile.steps[i].start) * lane.profile.steps[i].vehiclesPerHour / 3600;
+        }
+        lane.stream = RandomStream(seed, approachStreamId(STREAM_ARRIVAL, static_cast<int>(a)));
+        if (lane.expectedPerDay > 0) lane.expected = expectedBy(lane, from);
+        lane.next = lane.times.size();
+    }
+}
+
+int ProfileArrivalSource::densityAt(int approach, SimulationClock::time_point now) const {
+    if (approach >= static_cast<int>(lanes.size())) return 0;
+    double perSecond = lanes[approach].profile.rateAt(std::chrono::duration<double>(now.time_since_epoch()).count()) / 3600;
+    return std::clamp(static_cast<int>(std::lround(perSecond * 11 * RandomArrivalSource::arrivalWindowSeconds)) - 1, 0, 10);
+}
+
+RecordedDemand RecordedDemand::record(ArrivalSource& source, int approaches, SimulationClock::time_point until) {
+    RecordedDemand demand;
+    demand.arrivals.resize(approaches);
+    for (int a = 0; a < approaches; ++a)
+        for (Arrival next; source.nextArrival(a, 0, SimulationClock::time_point(), next) && next.time < until;) demand.arrivals[a].push_back(next);
+    return demand;
+}
+
+RecordedDemandSource::RecordedDemandSource(const RecordedDemand& recorded, SimulationClock::time_point start)
+    : demand(recorded) {
+    for (std::size_t a = 0; a < demand.arrivals.size() && a < next.size(); ++a) {
+        const auto& lane = demand.arrivals[a];
+        next[a] = std::lower_bound(lane.begin(), lane.end(), start, [](const Arrival& x, SimulationClock::time_point t) { return x.time < t; }) - lane.begin();
+    }
+}
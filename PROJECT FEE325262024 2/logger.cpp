@@ -0,0 +1,128 @@
+// Asynchronous logger: the bounded record queue and the drain thread
+
+#include "traffic_controller.h"
+
+bool Logger::tryPush(const LogRecord& r) {
+    std::size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    for (;;) {
+        Cell& cell = cells[pos & mask];
+        std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+        std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+        if (diff == 0) {
+            if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                cell.record = r;
+                cell.sequence.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+bool Logger::tryPop(LogRecord& r) {
+    Cell& cell = cells[dequeuePos & mask];
+    if (cell.sequence.load(std::memory_order_acquire) != dequeuePos + 1) return false;
+    r = cell.record;
+    cell.sequence.store(dequeuePos + mask + 1, std::memory_order_release);
+    ++dequeuePos;
+    return true;
+}
+
+void Logger::formatPhase(const LogRecord& r, char* name, std::size_t size) {
+    if (r.b < 0) std::snprintf(name, size, "%s", approachName(r.approaches, r.approach));
+    else std::snprintf(name, size, "%s-%s %s", approachName(r.approaches, r.approach), approachName(r.approaches, r.b), turnName(r.approaches, r.turn));
+}
+
+void Logger::format(const LogRecord& r, std::string& buffer) {
+    char line[160], phase[48];
+    int n = 0;
+    switch (r.message) {
+    case MSG_CYCLE_HEADER: n = std::snprintf(line, sizeof line, "\n=== Traffic Cycle #%lld ===\n", r.a); break;
+    case MSG_QUEUE_HEADER: n = std::snprintf(line, sizeof line, "\n--- Queue Status ---\n"); break;
+    case MSG_LANE_STATUS:
+        n = std::snprintf(line, sizeof line, "%s %s: %lld vehicles, Avg Wait: %.1fs, Density: %d, Ped Request: %s\n",
+            approachName(r.approaches, r.approach), turnName(r.approaches, r.turn), r.a, r.value, r.b, r.flag ? "Yes" : "No");
+        break;
+    case MSG_EMERGENCY: n = std::snprintf(line, sizeof line, "Emergency vehicle detected on %s!\n", approachName(r.approaches, r.approach)); break;
+    case MSG_YELLOW:
+        formatPhase(r, phase, sizeof phase);
+        n = std::snprintf(line, sizeof line, "Yellow light for %s\n", phase);
+        break;
+    case MSG_GREEN:
+        formatPhase(r, phase, sizeof phase);
+        n = std::snprintf(line, sizeof line, "Green light for %s (%llds)\n", phase, r.a);
+        break;
+    case MSG_PEDESTRIAN_WALK: n = std::snprintf(line, sizeof line, "Pedestrians WALK on %s\n", approachName(r.approaches, r.approach)); break;
+    case MSG_PEDESTRIAN_CLEARANCE:
+        n = std::snprintf(line, sizeof line, "Pedestrians flashing DON'T WALK on %s\n", approachName(r.approaches, r.approach));
+        break;
+    case MSG_VEHICLE_PASSED:
+        n = std::snprintf(line, sizeof line, "Vehicle #%lld%s passed from %s (%s) after waiting %.1fs\n",
+            r.a, r.flag ? " (EMERGENCY)" : "", approachName(r.approaches, r.approach), turnName(r.approaches, r.turn), r.value);
+        break;
+    case MSG_TOTAL_PASSED: n = std::snprintf(line, sizeof line, "Total vehicles passed: %lld\n", r.a); break;
+    case MSG_STATS:
+    case MSG_FINAL_STATS:
+        n = std::snprintf(line, sizeof line, "\n--- %sStatistics ---\nTotal Vehicles Processed: %lld\n",
+            r.message == MSG_FINAL_STATS ? "Final " : "", r.a);
+        buffer.append(line, n);
+        n = r.a ? std::snprintf(line, sizeof line, "Average Wait Time: %.2fs\n", r.value) : 0;
+        break;
+    }
+    buffer.append(line, n);
+}
+
+void Logger::drainLoop() {
+    std::string buffer;
+    LogRecord r;
+    for (;;) {
+        std::size_t drained = 0;
+        while (drained < 4096 && tryPop(r)) {
+            format(r, buffer);
+            ++drained;
+        }
+        if (drained) {
+            std::fwrite(buffer.data(), 1, buffer.size(), out);
+            std::fflush(out);
+            buffer.clear();
+            written.fetch_add(drained, std::memory_order_release);
+        } else if (stopping.load(std::memory_order_acquire)) {
+            return;
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+}
+
+Logger::Logger(std::FILE* output, std::size_t minCapacity)
+    : enqueuePos(0), dequeuePos(0), written(0), stopping(false), out(output) {
+    std::size_t capacity = 1;
+    while (capacity < minCapacity) capacity *= 2;
+    cells.reset(new Cell[capacity]);
+    for (std::size_t i = 0; i < capacity; ++i) cells[i].sequence.store(i, std::memory_order_relaxed);
+    mask = capacity - 1;
+    drainThread = std::thread(&Logger::drainLoop, this);
+}
+
+Logger::~Logger() {
+    flush();
+    stopping.store(true, std::memory_order_release);
+    drainThread.join();
+}
+
+Logger& Logger::global() {
+    static Logger instance;
+    return instance;
+}
+
+void Logger::write(const LogRecord& r) {
+    while (!tryPush(r)) std::this_thread::yield();
+}
+
+void Logger::flush() {
+    std::size_t target = enqueuePos.load(std::memory_order_acquire);
+    while (written.load(std::memory_order_acquire) < target) std::this_thread::yield();
+}
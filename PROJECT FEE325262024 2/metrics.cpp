@@ -0,0 +1,240 @@
+// Controller metrics, the Prometheus exposition and the scrape endpoint
+
+#include "traffic_controller.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+using AddressLength = int;
+static_assert(sizeof(SOCKET) == sizeof(std::uintptr_t), "MetricsServer::Socket holds a SOCKET");
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+using AddressLength = socklen_t;
+#endif
+
+std::mutex& Instrumentation::registryMutex() {
+    static std::mutex m;
+    return m;
+}
+
+std::vector<Instrumentation::ThreadMetrics*>& Instrumentation::registry() {
+    static std::vector<ThreadMetrics*> threads;
+    return threads;
+}
+
+MetricsSnapshot& Instrumentation::retired() {
+    static MetricsSnapshot totals;
+    return totals;
+}
+
+Instrumentation::ThreadMetrics& Instrumentation::local() {
+    thread_local std::unique_ptr<ThreadMetrics> metrics(new ThreadMetrics);
+    return *metrics;
+}
+
+MetricsSnapshot Instrumentation::snapshot() {
+    std::lock_guard<std::mutex> lock(registryMutex());
+    MetricsSnapshot out = retired();
+    for (const ThreadMetrics* t : registry()) t->addTo(out);
+    return out;
+}
+
+void Instrumentation::exportText(std::ostream& os) {
+    MetricsSnapshot m = snapshot();
+    os << std::fixed << std::setprecision(2);
+    os << "\n--- Phase Latency (us) ---\n";
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        const HistogramSnapshot& h = m.phaseLatency[p];
+        os << std::left << std::setw(24) << phaseName(static_cast<Phase>(p)) << std::right << " count " << h.total
+            << ", p50 " << h.percentile(50) / 1e3 << ", p99 " << h.percentile(99) / 1e3
+            << ", p999 " << h.percentile(99.9) / 1e3 << ", max " << h.maxValue / 1e3 << "\n";
+    }
+    os << "\n--- Vehicle Wait (s) ---\n";
+    int approaches = 4;
+    for (int d = 4; d < maxApproaches; ++d)
+        if (m.waitTime[d].total) approaches = d + 1;
+    for (int d = 0; d < approaches; ++d) {
+        const HistogramSnapshot& h = m.waitTime[d];
+        os << std::left << std::setw(6) << approachName(approaches, d) << std::right << " count " << h.total
+            << ", mean " << h.mean() / 1e9 << ", p50 " << h.percentile(50) / 1e9 << ", p99 " << h.percentile(99) / 1e9
+            << ", p999 " << h.percentile(99.9) / 1e9 << ", max " << h.maxValue / 1e9 << "\n";
+    }
+}
+
+void Instrumentation::exportPrometheus(std::ostream& os) {
+    MetricsSnapshot m = snapshot();
+    os << "# HELP tlc_step_latency_seconds Wall time spent in each controller step.\n"
+       << "# TYPE tlc_step_latency_seconds summary\n";
+    for (int p = 0; p < PHASE_COUNT; ++p) {
+        const HistogramSnapshot& h = m.phaseLatency[p];
+        const char* step = phaseName(static_cast<Phase>(p));
+        for (double q : { 0.5, 0.99, 0.999 })
+            os << "tlc_step_latency_seconds{step=\"" << step << "\",quantile=\"" << q << "\"} " << h.percentile(q * 100) / 1e9 << "\n";
+        os << "tlc_step_latency_seconds_sum{step=\"" << step << "\"} " << h.sum / 1e9 << "\n"
+           << "tlc_step_latency_seconds_count{step=\"" << step << "\"} " << h.total << "\n";
+    }
+}
+
+HistogramSnapshot ControllerMetrics::waitTimes() const {
+    HistogramSnapshot h;
+    for (int a = 0; a < approaches; ++a) perApproach[a].wait.addTo(h);
+    return h;
+}
+
+void ControllerMetrics::exportPrometheus(std::ostream& os) const {
+    os << "# HELP tlc_queue_length Vehicles queued on the approach.\n# TYPE tlc_queue_length gauge\n";
+    for (int a = 0; a < approaches; ++a)
+        os << "tlc_queue_length{approach=\"" << approachName(approaches, a) << "\"} " << perApproach[a].queued.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP tlc_vehicles_discharged_total Vehicles that crossed from the approach.\n# TYPE tlc_vehicles_discharged_total counter\n";
+    for (int a = 0; a < approaches; ++a)
+        os << "tlc_vehicles_discharged_total{approach=\"" << approachName(approaches, a) << "\"} " << perApproach[a].departures.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP tlc_vehicle_wait_seconds Queueing delay per discharged vehicle.\n# TYPE tlc_vehicle_wait_seconds summary\n";
+    for (int a = 0; a < approaches; ++a) {
+        HistogramSnapshot h;
+        perApproach[a].wait.addTo(h);
+        const char* name = approachName(approaches, a);
+        for (double q : { 0.5, 0.9, 0.99 })
+            os << "tlc_vehicle_wait_seconds{approach=\"" << name << "\",quantile=\"" << q << "\"} " << h.percentile(q * 100) / 1e9 << "\n";
+        os << "tlc_vehicle_wait_seconds_sum{approach=\"" << name << "\"} " << h.sum / 1e9 << "\n"
+           << "tlc_vehicle_wait_seconds_count{approach=\"" << name << "\"} " << h.total << "\n";
+    }
+    os << "# HELP tlc_phase_duration_seconds Time from a phase's green to the next green.\n# TYPE tlc_phase_duration_seconds summary\n";
+    for (std::size_t p = 0; p < perPhase.size(); ++p)
+        os << "tlc_phase_duration_seconds_sum{phase=\"" << p << "\"} " << perPhase[p].nanoseconds.load(std::memory_order_relaxed) / 1e9 << "\n"
+           << "tlc_phase_duration_seconds_count{phase=\"" << p << "\"} " << perPhase[p].count.load(std::memory_order_relaxed) << "\n";
+    os << "# HELP tlc_signal_phase Phase currently green, -1 before the first.\n# TYPE tlc_signal_phase gauge\n"
+       << "tlc_signal_phase " << currentPhase.load(std::memory_order_relaxed) << "\n"
+       << "# HELP tlc_cycles_total Signal cycles run.\n# TYPE tlc_cycles_total counter\n"
+       << "tlc_cycles_total " << cycles.load(std::memory_order_relaxed) << "\n"
+       << "# HELP tlc_emergency_preemptions_total Greens cut short for an emergency vehicle.\n# TYPE tlc_emergency_preemptions_total counter\n"
+       << "tlc_emergency_preemptions_total " << preemptions.load(std::memory_order_relaxed) << "\n"
+       << "# HELP tlc_emergency_preemption_latency_max_seconds Longest wait from an emergency arrival to its green.\n"
+       << "# TYPE tlc_emergency_preemption_latency_max_seconds gauge\n"
+       << "tlc_emergency_preemption_latency_max_seconds " << maxPreemptionNs.load(std::memory_order_relaxed) / 1e9 << "\n";
+}
+
+void MetricsServer::closeSocket(Socket s) {
+#ifdef _WIN32
+    closesocket(s);
+#else
+    close(s);
+#endif
+}
+
+bool MetricsServer::waitReadable(Socket s, int timeoutMs) {
+    pollfd p{};
+    p.fd = s;
+    p.events = POLLIN;
+#ifdef _WIN32
+    return WSAPoll(&p, 1, timeoutMs) > 0;
+#else
+    return poll(&p, 1, timeoutMs) > 0;
+#endif
+}
+
+// Each send gives up after sendTimeoutMs, and the response as a whole once that much
+// time has passed, so a scraper that stops reading cannot keep the server thread
+void MetricsServer::sendAll(Socket s, const std::string& data) {
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;    // a scraper that hangs up must not kill the process
+#else
+    const int flags = 0;
+#endif
+#ifdef _WIN32
+    DWORD timeout = sendTimeoutMs;
+#else
+    timeval timeout{ sendTimeoutMs / 1000, sendTimeoutMs % 1000 * 1000 };
+#endif
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&timeout), sizeof timeout);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(sendTimeoutMs);
+    for (std::size_t sent = 0; sent < data.size() && std::chrono::steady_clock::now() < deadline;) {
+        int n = static_cast<int>(send(s, data.data() + sent, static_cast<int>(data.size() - sent), flags));
+        if (n <= 0) return;
+        sent += n;
+    }
+}
+
+void MetricsServer::serve(Socket client) {
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192 && waitReadable(client, 1000)) {
+        int n = static_cast<int>(recv(client, buffer, sizeof buffer, 0));
+        if (n <= 0) break;
+        request.append(buffer, n);
+    }
+    std::string line = request.substr(0, request.find("\r\n"));
+    std::istringstream words(line);
+    std::string method, target;
+    words >> method >> target;
+    target = target.substr(0, target.find('?'));
+
+    std::ostringstream body;
+    const char* status = "200 OK";
+    if (method != "GET") status = "405 Method Not Allowed";
+    else if (target != "/metrics") status = "404 Not Found";
+    else {
+        body << std::setprecision(9);
+        render(body);
+        scrapes.store(scrapes.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    std::string text = body.str();
+    std::ostringstream response;
+    response << "HTTP/1.0 " << status << "\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\nContent-Length: "
+             << text.size() << "\r\nConnection: close\r\n\r\n" << text;
+    sendAll(client, response.str());
+}
+
+void MetricsServer::run() {
+    while (running.load(std::memory_order_acquire)) {
+        if (!waitReadable(listener, 100)) continue;
+        Socket client = accept(listener, nullptr, nullptr);
+        if (client == invalidSocket) continue;
+        serve(client);
+        closeSocket(client);
+    }
+}
+
+MetricsServer::MetricsServer(int port, std::function<void(std::ostream&)> exporter, const std::string& bindAddress)
+    : render(std::move(exporter)), listener(invalidSocket), boundPort(0), running(false), scrapes(0) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<std::uint16_t>(port));
+    if (inet_pton(AF_INET, bindAddress.c_str(), &address.sin_addr) != 1)
+        throw std::invalid_argument("Not an IPv4 address to serve metrics on: " + bindAddress);
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) throw std::runtime_error("Cannot start Winsock");
+#endif
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    if (listener != invalidSocket)
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof reuse);
+    AddressLength length = sizeof address;
+    if (listener == invalidSocket || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof address) != 0 || listen(listener, 16) != 0 ||
+        getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+        if (listener != invalidSocket) closeSocket(listener);
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        throw std::runtime_error("Cannot serve metrics on " + bindAddress + " port " + std::to_string(port));
+    }
+    boundPort = ntohs(address.sin_port);
+    running.store(true, std::memory_order_release);
+    thread = std::thread([this] { run(); });
+}
+
+MetricsServer::~MetricsServer() {
+    running.store(false, std::memory_order_release);
+    thread.join();
+    closeSocket(listener);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
@@ -0,0 +1,189 @@
+// Thread pool and the road network built on it
+
+#include "traffic_controller.h"
+
+void ThreadPool::runChunks() {
+    for (;;) {
+        std::size_t begin = nextIndex.fetch_add(chunkSize, std::memory_order_relaxed);
+        if (begin >= taskSize) return;
+        std::size_t end = std::min(begin + chunkSize, taskSize);
+        for (std::size_t i = begin; i < end; ++i) (*task)(i);
+    }
+}
+
+void ThreadPool::workerLoop() {
+    unsigned long long seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeWorkers.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping) return;
+            seen = generation;
+        }
+        runChunks();
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--busyWorkers == 0) workDone.notify_one();
+    }
+}
+
+ThreadPool::ThreadPool(unsigned threadCount)
+    : task(nullptr), taskSize(0), chunkSize(1), nextIndex(0), busyWorkers(0), generation(0), stopping(false) {
+    // The calling thread works too, so one thread means no extra workers
+    for (unsigned i = 1; i < std::max(threadCount, 1u); ++i) workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wakeWorkers.notify_all();
+    for (auto& w : workers) w.join();
+}
+
+void ThreadPool::parallelFor(std::size_t n, const std::function<void(std::size_t)>& f) {
+    if (n == 0) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        task = &f;
+        taskSize = n;
+        chunkSize = std::max<std::size_t>(1, n / (threadCount() * 8));    // claimed dynamically, see runChunks
+        nextIndex.store(0, std::memory_order_relaxed);
+        busyWorkers = workers.size();
+        ++generation;
+    }
+    wakeWorkers.notify_all();
+    runChunks();
+    std::unique_lock<std::mutex> lock(mutex);
+    workDone.wait(lock, [&] { return busyWorkers == 0; });
+}
+
+void RoadNetwork::stepNode(Node& node, SimulationClock::time_point stepEnd) {
+    // Anything pushed during this step arrives at or after stepEnd, so draining
+    // strictly before it is deterministic regardless of thread interleaving
+    for (RoadLink* link : node.inbound) {
+        while (const VehicleTransfer* v = link->transit.front()) {
+            if (v->arrivalTime >= stepEnd) break;
+            node.scheduler.scheduleAt(v->arrivalTime, LINK_ARRIVAL, link->entryLane, v->vehicle,
+                node.controller.getVehicle(v->vehicle).isEmergencyVehicle());
+            link->transit.pop();
+        }
+    }
+    node.scheduler.runUntil(stepEnd, [&](const Event& e) { node.controller.handleEvent(e, node.scheduler); });
+}
+
+void RoadNetwork::publishDownstreamQueues() {
+    for (auto& node : nodes) {
+        for (int exit = 0; exit < CrossroadsLayout::approaches(); ++exit) {
+            RoadLink* link = node->outbound[exit];
+            if (!link) continue;
+            std::size_t occupied = static_cast<std::size_t>(nodes[link->to]->controller.getApproachQueue(link->entryLane)) + link->transit.size();
+            link->room = link->storage - std::min(occupied, link->storage);
+            node->controller.setDownstreamQueue(exit, static_cast<int>(occupied));
+        }
+    }
+}
+
+std::size_t RoadNetwork::addIntersection() {
+    nodes.push_back(std::make_unique<Node>());
+    Node& node = *nodes.back();
+    node.controller.setLogLevel(LOG_OFF);
+    node.controller.setDepartureSink(&node);
+    node.controller.setVehicleArena(*vehicles);
+    return nodes.size() - 1;
+}
+
+void RoadNetwork::addLink(std::size_t from, Direction exitLane, std::size_t to, Direction entryLane,
+             SimulationClock::duration travelTime, std::size_t storageVehicles) {
+    if (travelTime < stepLength) throw std::invalid_argument("Link travel time must be at least one step");
+    links.push_back(std::make_unique<RoadLink>(to, entryLane, travelTime, storageVehicles));
+    nodes[from]->outbound[exitLane] = links.back().get();
+    nodes[to]->inbound.push_back(links.back().get());
+    nodes[to]->controller.setExternalDemand(entryLane, false);
+}
+
+RoadNetwork RoadNetwork::grid(int rows, int cols, std::uint64_t seed, SimulationClock::duration travelTime) {
+    RoadNetwork net(seed);
+    for (int i = 0; i < rows * cols; ++i) net.addIntersection();
+    auto at = [cols](int r, int c) { return static_cast<std::size_t>(r * cols + c); };
+    for (int r = 0; r < rows; ++r) {
+        for (int c = 0; c < cols; ++c) {
+            if (r + 1 < rows) net.addLink(at(r, c), SOUTH, at(r + 1, c), NORTH, travelTime);
+            if (r > 0) net.addLink(at(r, c), NORTH, at(r - 1, c), SOUTH, travelTime);
+            if (c > 0) net.addLink(at(r, c), WEST, at(r, c - 1), EAST, travelTime);
+            if (c + 1 < cols) net.addLink(at(r, c), EAST, at(r, c + 1), WEST, travelTime);
+        }
+    }
+    return net;
+}
+
+RoadNetwork RoadNetwork::corridor(int junctions, std::uint64_t seed, SimulationClock::duration travelTime) {
+    RoadNetwork net(seed);
+    for (int i = 0; i < junctions; ++i) net.addIntersection();
+    for (int i = 0; i + 1 < junctions; ++i) {
+        net.addLink(i, EAST, i + 1, WEST, travelTime);
+        net.addLink(i + 1, WEST, i, EAST, travelTime);
+    }
+    return net;
+}
+
+void RoadNetwork::runUntil(SimulationClock::time_point end, ThreadPool& pool) {
+    int count = static_cast<int>(nodes.size());
+    if (!started) {
+        for (int i = 0; i < count; ++i) {
+            nodes[i]->controller.setVehicleIdSequence(i + 1, count);
+            nodes[i]->controller.reseed(RandomStream::deriveSeed(seed, i));
+            if (!nodes[i]->demand.empty()) {
+                nodes[i]->arrivals = std::make_unique<ProfileArrivalSource>(nodes[i]->demand, RandomStream::deriveSeed(seed, i));
+                nodes[i]->controller.setArrivalSource(nodes[i]->arrivals.get());
+            }
+            nodes[i]->controller.start(nodes[i]->scheduler);
+        }
+        started = true;
+    }
+    std::function<void(std::size_t)> step;
+    while (currentTime < end) {
+        SimulationClock::time_point stepEnd = std::min(currentTime + stepLength, end);
+        publishDownstreamQueues();
+        step = [&](std::size_t i) { stepNode(*nodes[i], stepEnd); };
+        pool.parallelFor(nodes.size(), step);
+        currentTime = stepEnd;
+    }
+}
+
+void RoadNetwork::setSignalPolicy(const SignalPolicy& policy) {
+    for (auto& node : nodes) node->controller.setSignalPolicy(policy);
+}
+
+TripTotals RoadNetwork::completedTrips(int minJunctions) const {
+    TripTotals total;
+    for (const auto& node : nodes)
+        for (std::size_t crossed = std::max(minJunctions, 0); crossed < node->trips.size(); ++crossed) total += node->trips[crossed];
+    return total;
+}
+
+void RoadNetwork::displaySummary() const {
+    long long processed = 0, queued = 0, inTransit = 0;
+    SimulationClock::duration waited{};
+    for (const auto& node : nodes) {
+        processed += node->controller.getTotalVehiclesProcessed();
+        waited += node->controller.getTotalWaitTime();
+        queued += node->controller.getQueuedVehicles();
+    }
+    TripTotals trips = completedTrips();
+    long long exited = trips.vehicles;
+    for (const auto& link : links) inTransit += link->transit.size();
+    std::cout << "\n--- Network Statistics ---\n";
+    std::cout << "Intersections: " << nodes.size() << ", Links: " << links.size() << "\n";
+    std::cout << "Intersection Crossings: " << processed << ", Exited Network: " << exited
+        << ", Queued: " << queued << ", In Transit: " << inTransit << "\n";
+    if (processed)
+        std::cout << "Average Wait Per Crossing: " << std::fixed << std::setprecision(2)
+        << std::chrono::duration<double>(waited).count() / processed << "s\n";
+    if (exited)
+        std::cout << "Completed Trips: " << std::fixed << std::setprecision(2) << double(trips.junctions) / exited << " junctions, "
+        << std::chrono::duration<double>(trips.travel).count() / exited << "s travel, "
+        << std::chrono::duration<double>(trips.wait).count() / exited << "s waiting, "
+        << double(trips.stops) / exited << " stops on average\n";
+    std::cout << "Vehicle Records Live: " << vehicles->size() << "\n";
+}
@@ -0,0 +1,214 @@
+// Scenario files: the text format and its compiled binary form
+
+#include "traffic_controller.h"
+
+Scenario Scenario::load(const std::string& path) {
+    MappedFile file(path);
+    if (file.size() >= sizeof(ScenarioHeader) && std::equal(std::begin(scenarioMagic), std::end(scenarioMagic), file.data()))
+        return fromBinary(file, path);
+    return parse(std::string(reinterpret_cast<const char*>(file.data()), file.size()), path);
+}
+
+void Scenario::compile(const std::string& path) const {
+    ScenarioHeader header{};
+    std::copy(std::begin(scenarioMagic), std::end(scenarioMagic), header.magic);
+    header.version = 1;
+    header.intersections = static_cast<std::uint32_t>(intersections.size());
+    header.links = static_cast<std::uint32_t>(links.size());
+    header.profiles = static_cast<std::uint32_t>(profiles.size());
+    header.profileSteps = static_cast<std::uint32_t>(profileSteps.size());
+    header.seed = seed;
+    header.horizon = horizon.count();
+    header.step = step.count();
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) throw std::runtime_error("Cannot create " + path);
+    bool written = std::fwrite(&header, sizeof header, 1, file) == 1;
+    auto put = [&](const auto& records) {
+        if (!records.empty()) written = written && std::fwrite(records.data(), sizeof records[0], records.size(), file) == records.size();
+    };
+    put(intersections);
+    put(links);
+    put(profiles);
+    put(profileSteps);
+    if (std::fclose(file) != 0 || !written) throw std::runtime_error("Cannot write " + path);
+}
+
+std::vector<DemandProfile> Scenario::demandFor(const IntersectionRecord& intersection) const {
+    std::vector<DemandProfile> demand;
+    if (intersection.demand[0] < 0) return demand;
+    for (std::int32_t index : intersection.demand) {
+        const ProfileRecord& p = profiles[index];
+        demand.emplace_back(std::vector<DemandProfile::Step>(profileSteps.begin() + p.firstStep, profileSteps.begin() + p.firstStep + p.steps));
+    }
+    return demand;
+}
+
+RoadNetwork Scenario::build() const {
+    RoadNetwork net(seed, step);
+    for (std::size_t i = 0; i < intersections.size(); ++i) {
+        const IntersectionRecord& r = intersections[i];
+        net.addIntersection();
+        net.setSignalTiming(i, SignalTiming{ r.baseGreen, r.yellow, r.minGreen, r.maxGreen });
+        net.setSignalPolicy(i, policyAlternative(r.policy));
+        net.setDemandProfiles(i, demandFor(r));
+    }
+    for (const LinkRecord& l : links)
+        net.addLink(l.from, static_cast<Direction>(l.exit), l.to, static_cast<Direction>(l.entry), SimulationClock::duration(l.travelTime), l.storage);
+    return net;
+}
+
+Scenario Scenario::fromBinary(const MappedFile& file, const std::string& path) {
+    ScenarioHeader header;
+    std::memcpy(&header, file.data(), sizeof header);
+    if (header.version != 1) throw std::runtime_error("Unsupported scenario version in " + path);
+    Scenario scenario;
+    scenario.seed = header.seed;
+    scenario.horizon = SimulationClock::duration(header.horizon);
+    scenario.step = SimulationClock::duration(header.step);
+    const unsigned char* next = file.data() + sizeof header;
+    const unsigned char* last = file.data() + file.size();
+    auto take = [&](auto& records, std::uint32_t count) {
+        std::size_t bytes = count * sizeof records[0];
+        if (static_cast<std::size_t>(last - next) < bytes) throw std::runtime_error("Truncated scenario " + path);
+        records.resize(count);
+        if (bytes) std::memcpy(records.data(), next, bytes);
+        next += bytes;
+    };
+    take(scenario.intersections, header.intersections);
+    take(scenario.links, header.links);
+    take(scenario.profiles, header.profiles);
+    take(scenario.profileSteps, header.profileSteps);
+    scenario.validate(path);
+    return scenario;
+}
+
+void Scenario::validate(const std::string& path) const {
+    auto fail = [&](const std::string& what) { throw std::runtime_error(path + ": " + what); };
+    for (const ProfileRecord& p : profiles)
+        if (p.steps == 0 || p.firstStep + std::uint64_t(p.steps) > profileSteps.size()) fail("profile steps out of range");
+    for (const IntersectionRecord& r : intersections) {
+        if (r.policy >= std::variant_size<SignalPolicy>::value) fail("unknown signal policy");
+        bool random = r.demand[0] < 0;
+        for (std::int32_t d : r.demand)
+            if ((d < 0) != random || d >= static_cast<std::int32_t>(profiles.size())) fail("bad demand profile reference");
+    }
+    for (const LinkRecord& l : links)
+        if (l.from >= intersections.size() || l.to >= intersections.size() || l.exit > WEST || l.entry > WEST) fail("bad link");
+}
+
+Direction Scenario::parseSide(const std::string& side) {
+    switch (side.empty() ? 0 : std::toupper(static_cast<unsigned char>(side[0]))) {
+    case 'N': return NORTH;
+    case 'E': return EAST;
+    case 'S': return SOUTH;
+    case 'W': return WEST;
+    }
+    throw std::invalid_argument("Unknown side: " + side);
+}
+
+Scenario Scenario::parse(const std::string& text, const std::string& path) {
+    Scenario scenario;
+    IntersectionRecord defaults{ 20, 3, 10, 60, { -1, -1, -1, -1 }, 0, {} };
+    std::map<std::string, std::int32_t> profileIndex;
+    auto addProfile = [&](const std::string& name, const DemandProfile& profile) {
+        profileIndex[name] = static_cast<std::int32_t>(scenario.profiles.size());
+        scenario.profiles.push_back({ static_cast<std::uint32_t>(scenario.profileSteps.size()), static_cast<std::uint32_t>(profile.steps.size()) });
+        scenario.profileSteps.insert(scenario.profileSteps.end(), profile.steps.begin(), profile.steps.end());
+    };
+    auto seconds = [](const std::string& value) {
+        return std::chrono::duration_cast<SimulationClock::duration>(std::chrono::duration<double>(std::stod(value)));
+    };
+    // key=value settings shared by "timing", "policy" and "intersection" lines
+    auto apply = [&](IntersectionRecord& r, const std::string& key, const std::string& value) {
+        if (key == "base") r.baseGreen = std::stoi(value);
+        else if (key == "yellow") r.yellow = std::stoi(value);
+        else if (key == "min") r.minGreen = std::stoi(value);
+        else if (key == "max") r.maxGreen = std::stoi(value);
+        else if (key == "policy") r.policy = static_cast<std::uint8_t>(parsePolicy(value).index());
+        else if (key == "demand") {
+            std::vector<std::string> names;
+            std::stringstream list(value);
+            for (std::string item; std::getline(list, item, ',');) names.push_back(item);
+            if (names.size() != 1 && names.size() != 4) throw std::invalid_argument("demand takes 1 or 4 profiles");
+            for (int a = 0; a < 4; ++a) {
+                const std::string& name = names[names.size() == 1 ? 0 : a];
+                if (name == "random") r.demand[a] = -1;
+                else if (profileIndex.count(name)) r.demand[a] = profileIndex[name];
+                else throw std::invalid_argument("Unknown demand profile: " + name);
+            }
+        } else throw std::invalid_argument("Unknown setting: " + key);
+    };
+    auto applyAll = [&](IntersectionRecord& r, std::istringstream& words) {
+        for (std::string word; words >> word;) {
+            std::size_t eq = word.find('=');
+            if (eq == std::string::npos) throw std::invalid_argument("Expected key=value, got " + word);
+            apply(r, word.substr(0, eq), word.substr(eq + 1));
+        }
+    };
+
+    std::istringstream lines(text);
+    int lineNumber = 0;
+    for (std::string line; std::getline(lines, line);) {
+        ++lineNumber;
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::string command;
+        if (!(words >> command)) continue;
+        try {
+            std::string a, b, c, d, e, f;
+            if (command == "seed" && words >> a) scenario.seed = std::stoull(a);
+            else if (command == "horizon" && words >> a) scenario.horizon = seconds(a);
+            else if (command == "step" && words >> a) scenario.step = seconds(a);
+            else if (command == "policy" && words >> a) apply(defaults, "policy", a);
+            else if (command == "timing") applyAll(defaults, words);
+            else if (command == "demand" && words >> a) apply(defaults, "demand", a);
+            else if (command == "profile" && words >> a >> b) {
+                if (b == "rush-hour") addProfile(a, DemandProfile::rushHour(1).front());
+                else if (b.find(':') == std::string::npos) addProfile(a, DemandProfile::load(b, 1).front());
+                else {
+                    std::vector<DemandProfile::Step> steps;
+                    for (std::string item = b;; ) {
+                        std::size_t colon = item.find(':');
+                        if (colon == std::string::npos) throw std::invalid_argument("Expected seconds:rate, got " + item);
+                        steps.push_back({ std::stod(item.substr(0, colon)), std::stod(item.substr(colon + 1)) });
+                        if (!(words >> item)) break;
+                    }
+                    addProfile(a, DemandProfile(std::move(steps)));
+                }
+            } else if (command == "grid" && words >> a >> b) {
+                int rows = std::stoi(a), cols = std::stoi(b);
+                auto travel = words >> c ? seconds(c) : SimulationClock::duration(std::chrono::seconds(30));
+                auto first = static_cast<std::uint32_t>(scenario.intersections.size());
+                scenario.intersections.resize(first + rows * cols, defaults);
+                auto at = [&](int r, int col) { return first + static_cast<std::uint32_t>(r * cols + col); };
+                auto link = [&](std::uint32_t from, Direction exit, std::uint32_t to, Direction entry) {
+                    scenario.links.push_back({ from, to, travel.count(), 64, static_cast<std::uint8_t>(exit), static_cast<std::uint8_t>(entry), {} });
+                };
+                // Same order as RoadNetwork::grid
+                for (int r = 0; r < rows; ++r)
+                    for (int col = 0; col < cols; ++col) {
+                        if (r + 1 < rows) link(at(r, col), SOUTH, at(r + 1, col), NORTH);
+                        if (r > 0) link(at(r, col), NORTH, at(r - 1, col), SOUTH);
+                        if (col > 0) link(at(r, col), WEST, at(r, col - 1), EAST);
+                        if (col + 1 < cols) link(at(r, col), EAST, at(r, col + 1), WEST);
+                    }
+            } else if (command == "intersection" && words >> a) {
+                std::size_t id = std::stoul(a);
+                if (id > scenario.intersections.size()) throw std::invalid_argument("Intersections are numbered in order");
+                if (id == scenario.intersections.size()) scenario.intersections.push_back(defaults);
+                applyAll(scenario.intersections[id], words);
+            } else if (command == "link" && words >> a >> b >> c >> d >> e) {
+                std::uint32_t storage = words >> f ? static_cast<std::uint32_t>(std::stoul(f)) : 64;
+                if (seconds(e) < scenario.step) throw std::invalid_argument("Link travel time must be at least one step");
+                scenario.links.push_back({ static_cast<std::uint32_t>(std::stoul(a)), static_cast<std::uint32_t>(std::stoul(c)), seconds(e).count(), storage,
+                                           static_cast<std::uint8_t>(parseSide(b)), static_cast<std::uint8_t>(parseSide(d)), {} });
+            } else {
+                throw std::invalid_argument("Unknown or incomplete line");
+            }
+        } catch (const std::exception& error) {
+            throw std::runtime_error(path + ":" + std::to_string(lineNumber) + ": " + error.what());
+        }
+    }
+    scenario.validate(path);
+    return scenario;
+}
@@ -0,0 +1,269 @@
+// Binary traces: file mapping, chunked reads, the trace writer/reader and replay
+
+#include "traffic_controller.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+void MappedFile::map(const std::string& path, std::uint64_t offset, std::size_t requested, bool toEnd) {
+    std::uint64_t total = fileSize(path);
+    if (offset > total) offset = total;
+    length = toEnd ? static_cast<std::size_t>(total - offset) : static_cast<std::size_t>(std::min<std::uint64_t>(requested, total - offset));
+    if (!length) return;
+    std::uint64_t aligned = offset - offset % granularity();
+    viewLength = static_cast<std::size_t>(offset - aligned) + length;
+#ifdef _WIN32
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("Cannot open " + path);
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping)
+        view = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, static_cast<DWORD>(aligned >> 32),
+                                                               static_cast<DWORD>(aligned), viewLength));
+    if (!view) {
+        if (mapping) CloseHandle(mapping);
+        CloseHandle(file);
+        throw std::runtime_error("Cannot map " + path);
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("Cannot open " + path);
+    void* p = mmap(nullptr, viewLength, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(aligned));
+    close(fd);
+    if (p == MAP_FAILED) throw std::runtime_error("Cannot map " + path);
+    madvise(p, viewLength, MADV_SEQUENTIAL);
+    view = static_cast<const unsigned char*>(p);
+#endif
+    bytes = view + (offset - aligned);
+}
+
+MappedFile::MappedFile(const std::string& path)
+    : view(nullptr), bytes(nullptr), length(0), viewLength(0) {
+#ifdef _WIN32
+    file = INVALID_HANDLE_VALUE;
+    mapping = nullptr;
+#endif
+    map(path, 0, 0, true);
+}
+
+MappedFile::MappedFile(const std::string& path, std::uint64_t offset, std::size_t windowBytes)
+    : view(nullptr), bytes(nullptr), length(0), viewLength(0) {
+#ifdef _WIN32
+    file = INVALID_HANDLE_VALUE;
+    mapping = nullptr;
+#endif
+    map(path, offset, windowBytes, false);
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+    if (view) UnmapViewOfFile(view);
+    if (mapping) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+    if (view) munmap(const_cast<unsigned char*>(view), viewLength);
+#endif
+}
+
+std::uint64_t MappedFile::fileSize(const std::string& path) {
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &info)) throw std::runtime_error("Cannot open " + path);
+    return (static_cast<std::uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) throw std::runtime_error("Cannot open " + path);
+    return static_cast<std::uint64_t>(st.st_size);
+#endif
+}
+
+std::uint64_t MappedFile::granularity() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+#else
+    return static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+bool ChunkedFileReader::ensure(std::size_t need) {
+    if (window && position + need <= windowStart + window->size()) return true;
+    if (position >= fileLength) return false;
+    if (need > windowBytes) windowBytes = need * 2;
+    window.reset();    // release the old window before mapping the next one
+    window = std::make_unique<MappedFile>(path, position, windowBytes);
+    windowStart = position;
+    return position + need <= fileLength;
+}
+
+bool ChunkedFileReader::readLine(const char*& text, std::size_t& n) {
+    const std::size_t probe = 256;
+    for (std::size_t need = std::min<std::uint64_t>(probe, fileLength - position);; need *= 2) {
+        if (atEnd()) return false;
+        ensure(need);
+        const char* begin = reinterpret_cast<const char*>(window->data() + (position - windowStart));
+        std::size_t available = static_cast<std::size_t>(windowStart + window->size() - position);
+        const char* newline = static_cast<const char*>(std::memchr(begin, '\n', available));
+        if (newline || position + available == fileLength) {
+            std::size_t lineLength = newline ? static_cast<std::size_t>(newline - begin) : available;
+            text = begin;
+            n = lineLength && begin[lineLength - 1] == '\r' ? lineLength - 1 : lineLength;
+            position += lineLength + (newline ? 1 : 0);
+            return true;
+        }
+        need = std::max(need, available);
+    }
+}
+
+TraceWriter::TraceWriter(const std::string& tracePath, int approaches, std::size_t bufferRecords)
+    : path(tracePath), file(std::fopen(tracePath.c_str(), "wb")), buffer(bufferRecords), used(0), recordCount(0) {
+    if (!file) throw std::runtime_error("Cannot create " + path);
+    std::setvbuf(file, nullptr, _IONBF, 0);
+    TraceHeader header{};
+    std::copy(std::begin(traceMagic), std::end(traceMagic), header.magic);
+    header.version = 3;
+    header.approaches = static_cast<std::uint16_t>(approaches);
+    header.recordSize = sizeof(TraceRecord);
+    if (std::fwrite(&header, sizeof header, 1, file) != 1) {
+        std::fclose(file);
+        throw std::runtime_error("Cannot write " + path);
+    }
+}
+
+TraceWriter::~TraceWriter() {
+    if (!file) return;
+    try {
+        close();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << "\n";
+    }
+}
+
+void TraceWriter::flush() {
+    if (!file) throw std::runtime_error("Trace " + path + " is closed");
+    std::size_t pending = used;
+    used = 0;
+    if (pending && std::fwrite(buffer.data(), sizeof(TraceRecord), pending, file) != pending)
+        throw std::runtime_error("Cannot write " + path + ": the trace is truncated");
+}
+
+void TraceWriter::close() {
+    if (!file) return;
+    std::FILE* f = file;
+    bool flushed = true;
+    try {
+        flush();
+    } catch (const std::runtime_error&) {
+        flushed = false;
+    }
+    file = nullptr;
+    if (std::fclose(f) != 0 || !flushed) throw std::runtime_error("Cannot write " + path + ": the trace is truncated");
+}
+
+TraceReader::TraceReader(const std::string& path)
+    : file(path), first(nullptr), count(0), legs(4) {
+    if (file.size() < sizeof(TraceHeader)) throw std::runtime_error("Not a trace file: " + path);
+    TraceHeader header;
+    std::memcpy(&header, file.data(), sizeof header);
+    if (!std::equal(std::begin(traceMagic), std::end(traceMagic), header.magic) || header.recordSize != sizeof(TraceRecord))
+        throw std::runtime_error("Not a trace file: " + path);
+    if (header.approaches) legs = std::min<int>(header.approaches, maxApproaches);
+    first = reinterpret_cast<const TraceRecord*>(file.data() + sizeof(TraceHeader));
+    count = (file.size() - sizeof(TraceHeader)) / sizeof(TraceRecord);
+}
+
+bool TraceArrivalSource::parseCsv(ChunkedFileReader& reader, Arrival& out) {
+    const char* text;
+    std::size_t n;
+    while (reader.readLine(text, n)) {
+        char line[64];
+        n = std::min(n, sizeof line - 1);
+        std::memcpy(line, text, n);
+        line[n] = '\0';
+        char* end;
+        double seconds = std::strtod(line, &end);
+        if (end == line) continue;    // header or blank line
+        out.time = SimulationClock::time_point(std::chrono::duration_cast<SimulationClock::duration>(std::chrono::duration<double>(seconds)));
+        out.emergency = *end == ',' && std::strtol(end + 1, &end, 10) != 0;
+        out.turn = -1;
+        if (*end == ',') {
+            switch (std::toupper(static_cast<unsigned char>(end[1]))) {
+            case 'T': out.turn = THROUGH; break;
+            case 'L': out.turn = LEFT; break;
+            case 'R': out.turn = RIGHT; break;
+            default:
+                if (std::isdigit(static_cast<unsigned char>(end[1]))) out.turn = static_cast<int>(std::strtol(end + 1, nullptr, 10));
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+TraceArrivalSource::TraceArrivalSource(const std::vector<std::string>& lanePaths)
+    : inputs(lanePaths.size()) {
+    for (std::size_t i = 0; i < lanePaths.size(); ++i) {
+        if (lanePaths[i].empty()) continue;
+        inputs[i].reader = std::make_unique<ChunkedFileReader>(lanePaths[i]);
+        const std::string& p = lanePaths[i];
+        inputs[i].csv = p.size() >= 4 && p.compare(p.size() - 4, 4, ".csv") == 0;
+    }
+}
+
+bool TraceArrivalSource::nextArrival(int approach, int, SimulationClock::time_point, Arrival& out) {
+    if (approach >= static_cast<int>(inputs.size())) return false;
+    LaneInput& input = inputs[approach];
+    if (!input.reader) return false;
+    if (input.csv) return parseCsv(*input.reader, out);
+    ArrivalRecord r;
+    if (!input.reader->read(&r, sizeof r)) return false;
+    out.time = SimulationClock::time_point(SimulationClock::duration(r.time));
+    out.emergency = r.emergency != 0;
+    out.turn = r.turn - 1;
+    return true;
+}
+
+void summarizeTrace(const TraceReader& trace) {
+    std::array<long long, maxApproaches> arrivals{}, departures{}, greens{}, crossings{};
+    std::array<long long, maxApproaches> waitTicks{};
+    std::array<std::int64_t, maxApproaches> lastGreen;    // a phase greens several movements of an approach at once
+    lastGreen.fill(-1);
+    std::uint32_t lastCycle = 0;
+    std::int64_t lastTime = 0;
+    for (const TraceRecord& r : trace) {
+        std::size_t d = r.approach % maxApproaches;
+        switch (r.type) {
+        case TRACE_ARRIVAL: ++arrivals[d]; break;
+        case TRACE_DEPARTURE:
+            ++departures[d];
+            waitTicks[d] += r.time - r.arrivalTime;
+            break;
+        case TRACE_LIGHT_CHANGE:
+            if (r.value == GREEN && r.time != lastGreen[d]) {
+                ++greens[d];
+                lastGreen[d] = r.time;
+            }
+            break;
+        case TRACE_PEDESTRIAN_GRANT: ++crossings[d]; break;
+        }
+        lastCycle = std::max(lastCycle, r.cycle);
+        lastTime = std::max(lastTime, r.time);
+    }
+
+    std::cout << "\n--- Trace Summary ---\n";
+    std::cout << "Records: " << trace.size() << ", Cycles: " << lastCycle << ", Duration: " << std::fixed << std::setprecision(1)
+        << lastTime / 1e9 << "s\n";
+    for (int d = 0; d < trace.approaches(); ++d) {
+        std::cout << approachName(trace.approaches(), d) << ": " << arrivals[d] << " arrivals, " << departures[d]
+            << " departures, Avg Wait: " << std::setprecision(2) << (departures[d] ? waitTicks[d] / 1e9 / departures[d] : 0.0)
+            << "s, Greens: " << greens[d] << ", Ped Crossings: " << crossings[d] << "\n";
+    }
+}
@@ -0,0 +1,68 @@
+#include "traffic_controller.h"
+
+template class BasicIntersectionController<3>;
+template class BasicIntersectionController<4>;
+template class BasicIntersectionController<dynamicApproaches>;
+
+JunctionLayout<dynamicApproaches>::JunctionLayout(int approaches) : legs(approaches) {
+    if (approaches < 3 || approaches > maxApproaches) throw std::invalid_argument("Junctions have 3 to 8 approaches");
+    conflictTable.assign(movements(), 0);
+    for (int i = 0; i < movements(); ++i)
+        for (int j = 0; j < movements(); ++j)
+            if (movementsConflict(legs, i, j)) conflictTable[i] |= MovementMask(1) << j;
+    buildPhasePlan(legs, [this](const SignalPhase& p) { phaseTable.push_back(p); });
+}
+
+SignalPolicy parsePolicy(const std::string& name) {
+    if (name == AdaptivePolicy::name) return AdaptivePolicy{};
+    if (name == FixedTimePolicy::name) return FixedTimePolicy{};
+    if (name == ActuatedPolicy::name) return ActuatedPolicy{};
+    if (name == MaxPressurePolicy::name) return MaxPressurePolicy{};
+    if (name == CoordinatedPolicy::name) return CoordinatedPolicy{};
+    throw std::invalid_argument("Unknown signal policy: " + name);
+}
+
+CheckpointWriter::CheckpointWriter(int approaches) {
+    CheckpointHeader header{};
+    std::copy(std::begin(checkpointMagic), std::end(checkpointMagic), header.magic);
+    header.version = 1;
+    header.approaches = static_cast<std::uint16_t>(approaches);
+    write(header);
+}
+
+void CheckpointWriter::save(const std::string& path) const {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) throw std::runtime_error("Cannot create " + path);
+    bool written = std::fwrite(data.data(), 1, data.size(), file) == data.size();
+    if (std::fclose(file) != 0 || !written) throw std::runtime_error("Cannot write " + path);
+}
+
+CheckpointReader::CheckpointReader(const unsigned char* data, std::size_t size)
+    : next(data), last(data + size), legs(0) {
+    if (size < sizeof(CheckpointHeader)) throw std::runtime_error("Not a checkpoint");
+    CheckpointHeader header = read<CheckpointHeader>();
+    if (!std::equal(std::begin(checkpointMagic), std::end(checkpointMagic), header.magic) || header.version != 1)
+        throw std::runtime_error("Not a checkpoint");
+    legs = header.approaches;
+}
+
+void EventScheduler::saveState(CheckpointWriter& out) const {
+    out.write(clock.now());
+    out.write(nextSequence);
+    out.write(static_cast<std::uint64_t>(events.size()));
+    for (auto queued = events; !queued.empty(); queued.pop()) out.write(queued.top());
+}
+
+void EventScheduler::restoreState(CheckpointReader& in) {
+    // Read it all before replacing anything, so a truncated checkpoint leaves the queue as it was
+    SimulationClock::time_point now = in.read<SimulationClock::time_point>();
+    unsigned long long sequence = in.read<unsigned long long>();
+    std::uint64_t n = in.read<std::uint64_t>();
+    if (n > in.remaining() / sizeof(Event)) throw std::runtime_error("Corrupt checkpoint");
+    std::vector<Event> pending;
+    pending.reserve(n);
+    for (; n > 0; --n) pending.push_back(in.read<Event>());
+    clock.resetTo(now);
+    nextSequence = sequence;
+    events = decltype(events)(Later(), std::move(pending));
+}
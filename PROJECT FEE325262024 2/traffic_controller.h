@@ -0,0 +1,3517 @@
+// Traffic light controller library: junction layouts, signal policies, the cycle and
+// event engines, networks and the tools around them. Templates and the small types on
+// the hot path are defined here; everything else lives in the tlc_core sources beside
+// this header, and traffic_controller.cpp holds the common controller instantiations.
+#pragma once
+
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+#include <iostream>
+#include <queue>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <iomanip>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <cctype>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <sstream>
+#include <variant>
+#include <type_traits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+enum Direction { NORTH = 0, EAST, SOUTH, WEST };
+enum LightState { RED, YELLOW, GREEN };
+enum PedestrianState { DONT_WALK, WALK, FLASHING_DONT_WALK };
+
+// Junction geometry. Approaches are legs spaced evenly clockwise (NORTH, EAST, SOUTH,
+// WEST on a 4-way) and traffic keeps right. Every approach has one lane per exit leg
+// other than its own, and a signal phase is the set of movements (one bit each) that
+// are green together.
+enum Movement { THROUGH = 0, LEFT, RIGHT };    // turn indices on a 4-way junction
+
+using MovementMask = std::uint64_t;
+constexpr int maxApproaches = 8;
+constexpr int maxMovements = maxApproaches * (maxApproaches - 1);
+constexpr int dynamicApproaches = 0;    // layout chosen at run time
+static_assert(maxMovements <= 64, "one mask bit per movement");
+
+// Turns are numbered straightest first, left before right, so a 4-way has THROUGH,
+// LEFT, RIGHT. Turn t leaves by the leg turnOffset() places clockwise of its approach.
+constexpr int turnOffset(int approaches, int turn) {
+    for (int skew = 0, seen = 0; skew <= approaches; ++skew) {
+        for (int k = 1; k < approaches; ++k) {
+            int d = 2 * k - approaches;
+            if ((d < 0 ? -d : d) == skew && seen++ == turn) return k;
+        }
+    }
+    return 0;
+}
+
+// Each leg has an entry point and, clockwise of it, an exit point on the rim of the
+// junction. Two movements conflict when they share an exit or their chords across
+// the rim cross; a right turn joins neighbouring points, so it can only merge.
+constexpr bool movementsConflict(int approaches, int i, int j) {
+    int turns = approaches - 1;
+    int a = i / turns, b = j / turns;
+    if (a == b) return false;
+    int x = (a + turnOffset(approaches, i % turns)) % approaches;
+    int y = (b + turnOffset(approaches, j % turns)) % approaches;
+    if (x == y) return true;
+    int lo = std::min(2 * a, 2 * x + 1), hi = std::max(2 * a, 2 * x + 1);
+    bool entryInside = 2 * b > lo && 2 * b < hi, exitInside = 2 * y + 1 > lo && 2 * y + 1 < hi;
+    return entryInside != exitInside;
+}
+
+struct SignalPhase {
+    MovementMask movements;
+    int approach;
+    int pairedApproach;    // -1 for a phase that serves one approach
+    int turn;              // turn both approaches of a paired phase share; -1 otherwise
+};
+
+// For each pair of facing approaches (every pair on an odd junction, which has none
+// facing) and each turn: that turn on both, plus every compatible movement of the pair.
+// Then one phase per approach running all of its movements, used to clear an
+// emergency vehicle.
+template <typename Emit>
+constexpr void buildPhasePlan(int approaches, Emit&& emit) {
+    int turns = approaches - 1;
+    auto conflicts = [approaches, turns](int m, MovementMask set) {
+        for (int n = 0; n < approaches * turns; ++n)
+            if ((set >> n & 1) && movementsConflict(approaches, m, n)) return true;
+        return false;
+    };
+    for (int a = 0; a < approaches; ++a) {
+        for (int b = a + 1; b < approaches; ++b) {
+            if (approaches % 2 == 0 && b != a + approaches / 2) continue;
+            MovementMask covered = 0;
+            for (int t = 0; t < turns; ++t) {
+                int ma = a * turns + t, mb = b * turns + t;
+                if ((covered >> ma & 1) && (covered >> mb & 1)) continue;
+                MovementMask set = MovementMask(1) << ma;
+                for (int u = 0; u < turns; ++u) {
+                    for (int m : { b * turns + (u + t) % turns, a * turns + (u + t) % turns })
+                        if (!conflicts(m, set)) set |= MovementMask(1) << m;
+                }
+                covered |= set;
+                emit(SignalPhase{ set, a, b, t });
+            }
+        }
+    }
+    for (int a = 0; a < approaches; ++a)
+        emit(SignalPhase{ ((MovementMask(1) << turns) - 1) << (a * turns), a, -1, -1 });
+}
+
+constexpr int phaseCapacity(int approaches) {
+    return (approaches % 2 == 0 ? approaches / 2 : approaches * (approaches - 1) / 2) * (approaches - 1) + approaches;
+}
+
+template <int N>
+struct PhasePlan {
+    std::array<SignalPhase, phaseCapacity(N)> phases{};
+    int count = 0;
+};
+
+template <int N>
+constexpr PhasePlan<N> makePhasePlan() {
+    PhasePlan<N> plan;
+    buildPhasePlan(N, [&plan](const SignalPhase& p) { plan.phases[plan.count++] = p; });
+    return plan;
+}
+
+template <int N>
+constexpr std::array<MovementMask, N * (N - 1)> makeConflictMatrix() {
+    std::array<MovementMask, N * (N - 1)> matrix{};
+    for (int i = 0; i < N * (N - 1); ++i)
+        for (int j = 0; j < N * (N - 1); ++j)
+            if (movementsConflict(N, i, j)) matrix[i] |= MovementMask(1) << j;
+    return matrix;
+}
+
+// Layout fixed at compile time: the conflict matrix and phase plan are constexpr
+// tables and loops over approaches or movements have constant trip counts
+template <int N>
+struct JunctionLayout {
+    static_assert(N >= 3 && N <= maxApproaches, "junctions have 3 to 8 approaches");
+
+    template <typename T> using ApproachArray = std::array<T, N>;
+    template <typename T> using MovementArray = std::array<T, N * (N - 1)>;
+
+    // conflictTable[m] has a bit set for every movement that may not run alongside m
+    static constexpr std::array<MovementMask, N * (N - 1)> conflictTable = makeConflictMatrix<N>();
+    static constexpr PhasePlan<N> phasePlan = makePhasePlan<N>();
+
+    static constexpr int approaches() { return N; }
+    static constexpr int turns() { return N - 1; }
+    static constexpr int movements() { return N * (N - 1); }
+    static constexpr int movementIndex(int approach, int turn) { return approach * (N - 1) + turn; }
+    static constexpr int approachOf(int movement) { return movement / (N - 1); }
+    static constexpr int turnOf(int movement) { return movement % (N - 1); }
+    static constexpr int exitOf(int movement) { return (approachOf(movement) + turnOffset(N, turnOf(movement))) % N; }
+    static constexpr MovementMask movementBit(int approach, int turn) { return MovementMask(1) << movementIndex(approach, turn); }
+    static constexpr MovementMask conflicts(int movement) { return conflictTable[movement]; }
+
+    static constexpr int phaseCount() { return phasePlan.count; }
+    static constexpr const SignalPhase& phase(int p) { return phasePlan.phases[p]; }
+    static constexpr int approachPhase(int approach) { return phasePlan.count - N + approach; }
+
+    static constexpr bool compatible(MovementMask set) {
+        for (int m = 0; m < movements(); ++m)
+            if ((set >> m & 1) && (conflicts(m) & set)) return false;
+        return true;
+    }
+};
+
+// Layout chosen at run time for unusual junctions; same interface, tables on the heap
+template <>
+class JunctionLayout<dynamicApproaches> {
+private:
+    int legs;
+    std::vector<MovementMask> conflictTable;
+    std::vector<SignalPhase> phaseTable;
+
+public:
+    template <typename T> using ApproachArray = std::vector<T>;
+    template <typename T> using MovementArray = std::vector<T>;
+
+    explicit JunctionLayout(int approaches = 4);
+
+    int approaches() const { return legs; }
+    int turns() const { return legs - 1; }
+    int movements() const { return legs * (legs - 1); }
+    int movementIndex(int approach, int turn) const { return approach * (legs - 1) + turn; }
+    int approachOf(int movement) const { return movement / (legs - 1); }
+    int turnOf(int movement) const { return movement % (legs - 1); }
+    int exitOf(int movement) const { return (approachOf(movement) + turnOffset(legs, turnOf(movement))) % legs; }
+    MovementMask movementBit(int approach, int turn) const { return MovementMask(1) << movementIndex(approach, turn); }
+    MovementMask conflicts(int movement) const { return conflictTable[movement]; }
+
+    int phaseCount() const { return static_cast<int>(phaseTable.size()); }
+    const SignalPhase& phase(int p) const { return phaseTable[p]; }
+    int approachPhase(int approach) const { return phaseCount() - legs + approach; }
+
+    bool compatible(MovementMask set) const {
+        for (int m = 0; m < movements(); ++m)
+            if ((set >> m & 1) && (conflicts(m) & set)) return false;
+        return true;
+    }
+};
+
+template <int N>
+constexpr bool validPhasePlan() {
+    using Layout = JunctionLayout<N>;
+    MovementMask served = 0;
+    for (int p = 0; p < Layout::phaseCount(); ++p) {
+        if (!Layout::compatible(Layout::phase(p).movements)) return false;
+        served |= Layout::phase(p).movements;
+    }
+    return served == (MovementMask(1) << Layout::movements()) - 1;
+}
+static_assert(validPhasePlan<3>() && validPhasePlan<4>() && validPhasePlan<6>(), "phases must be conflict free and serve every movement");
+
+// The 4-way plan: paired throughs with their right turns, paired lefts, then each approach alone
+using CrossroadsLayout = JunctionLayout<4>;
+static_assert(CrossroadsLayout::phaseCount() == 8, "four paired phases and four approach phases");
+static_assert(CrossroadsLayout::phase(0).movements == (CrossroadsLayout::movementBit(NORTH, THROUGH) | CrossroadsLayout::movementBit(NORTH, RIGHT) |
+                                                       CrossroadsLayout::movementBit(SOUTH, THROUGH) | CrossroadsLayout::movementBit(SOUTH, RIGHT)),
+              "north-south through phase");
+static_assert(CrossroadsLayout::phase(1).movements == (CrossroadsLayout::movementBit(NORTH, LEFT) | CrossroadsLayout::movementBit(SOUTH, LEFT)),
+              "north-south left phase");
+
+// Simulation clock: real time for deployed controllers, virtual time for fast simulation
+class SimulationClock {
+public:
+    using duration = std::chrono::nanoseconds;
+    using time_point = std::chrono::time_point<SimulationClock, duration>;
+
+    virtual ~SimulationClock() = default;
+
+    // Time elapsed since the clock started
+    virtual time_point now() const = 0;
+    // Let time pass: sleeps in real-time mode, jumps forward in virtual mode
+    virtual void waitFor(duration d) = 0;
+};
+
+class RealTimeClock : public SimulationClock {
+private:
+    std::chrono::steady_clock::time_point start;    // monotonic: wall-clock adjustments never bend wait times
+
+public:
+    RealTimeClock() : start(std::chrono::steady_clock::now()) {}
+
+    time_point now() const override {
+        return time_point(std::chrono::duration_cast<duration>(std::chrono::steady_clock::now() - start));
+    }
+
+    void waitFor(duration d) override { std::this_thread::sleep_for(d); }
+};
+
+class VirtualClock : public SimulationClock {
+private:
+    time_point current;
+
+public:
+    VirtualClock() : current() {}
+
+    time_point now() const override { return current; }
+    void waitFor(duration d) override { current += d; }
+    void advanceTo(time_point t) { current = std::max(current, t); }
+    // Jump to a restored checkpoint's time, backwards included
+    void resetTo(time_point t) { current = t; }
+};
+
+// Vehicle record: identity plus trip statistics gathered across every junction it
+// crosses. Stored once in a VehicleArena; lanes and links pass its handle around.
+class Vehicle {
+private:
+    int id;
+    bool emergency;
+    SimulationClock::time_point entryTime;    // when it first joined a queue
+    SimulationClock::duration tripWait;       // queueing delay summed over junctions
+    int junctionsCrossed, stops;
+
+public:
+    Vehicle() : Vehicle(0, SimulationClock::time_point()) {}
+    Vehicle(int vehicleId, SimulationClock::time_point entry, bool isEmergency = false)
+        : id(vehicleId), emergency(isEmergency), entryTime(entry), tripWait(0), junctionsCrossed(0), stops(0) {}
+    Vehicle(int vehicleId, const SimulationClock& simClock, bool isEmergency = false) : Vehicle(vehicleId, simClock.now(), isEmergency) {}
+
+    int getId() const { return id; }
+    bool isEmergencyVehicle() const { return emergency; }
+    SimulationClock::time_point getEntryTime() const { return entryTime; }
+    SimulationClock::duration getTripWait() const { return tripWait; }
+    int getJunctionsCrossed() const { return junctionsCrossed; }
+    int getStops() const { return stops; }
+
+    // `stopped` when the vehicle was held at the junction rather than crossing in stride
+    void recordCrossing(SimulationClock::duration waited, bool stopped) {
+        tripWait += waited;
+        ++junctionsCrossed;
+        stops += stopped;
+    }
+    // Undo a crossing whose exit turned out to be blocked
+    void revertCrossing(SimulationClock::duration waited, bool stopped) {
+        tripWait -= waited;
+        --junctionsCrossed;
+        stops -= stopped;
+    }
+};
+
+// 32-bit generational handle: slot index in the low 24 bits, the slot's generation in
+// the top 8, so a handle kept past its vehicle's retirement no longer resolves
+using VehicleHandle = std::uint32_t;
+
+// Slab of vehicle records shared by every controller of a network. Slots live in
+// fixed-size chunks that never move, so resolving a handle takes no lock; only
+// handing out and taking back batches of free slots does. A record is owned by
+// whichever controller holds its handle, and ownership passes with the handle.
+class VehicleArena {
+private:
+    static constexpr int slotBits = 24, chunkBits = 12;
+    static constexpr std::uint32_t slotMask = (1u << slotBits) - 1;
+    static constexpr std::size_t chunkSize = std::size_t(1) << chunkBits, maxChunks = (std::size_t(1) << slotBits) / chunkSize;
+
+    struct Slot {
+        Vehicle vehicle;
+        std::uint8_t generation = 0;
+        bool live = false;
+    };
+
+    std::unique_ptr<std::atomic<Slot*>[]> chunks;    // allocated with the first chunk, as most controllers share an arena
+    std::size_t chunkCount;                  // guarded by mutex
+    std::vector<VehicleHandle> freeHandles;  // guarded by mutex
+    std::mutex mutex;
+    std::atomic<std::int64_t> liveCount;
+
+    Slot& slot(VehicleHandle h) const {
+        std::uint32_t index = h & slotMask;
+        return chunks[index >> chunkBits].load(std::memory_order_acquire)[index & (chunkSize - 1)];
+    }
+
+public:
+    VehicleArena() : chunkCount(0), liveCount(0) {}
+    ~VehicleArena() {
+        for (std::size_t c = 0; c < chunkCount; ++c) delete[] chunks[c].load(std::memory_order_relaxed);
+    }
+
+    VehicleArena(const VehicleArena&) = delete;
+    VehicleArena& operator=(const VehicleArena&) = delete;
+
+    // Move `count` free handles into `out`, carving a new chunk when none are left
+    void acquire(std::vector<VehicleHandle>& out, std::size_t count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (freeHandles.size() < count) {
+            if (chunkCount == maxChunks) throw std::runtime_error("Vehicle arena exhausted");
+            if (!chunks) chunks.reset(new std::atomic<Slot*>[maxChunks]());
+            chunks[chunkCount].store(new Slot[chunkSize], std::memory_order_release);
+            std::uint32_t first = static_cast<std::uint32_t>(chunkCount++ * chunkSize);
+            for (std::size_t i = chunkSize; i-- > 0;) freeHandles.push_back(first + static_cast<std::uint32_t>(i));
+        }
+        out.insert(out.end(), freeHandles.end() - count, freeHandles.end());
+        freeHandles.resize(freeHandles.size() - count);
+    }
+
+    // Return the last `count` handles of `from`, which were retired or never used
+    void release(std::vector<VehicleHandle>& from, std::size_t count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        freeHandles.insert(freeHandles.end(), from.end() - count, from.end());
+        from.resize(from.size() - count);
+    }
+
+    // Fill a free handle's slot; the handle becomes live
+    void create(VehicleHandle h, const Vehicle& vehicle) {
+        Slot& s = slot(h);
+        s.vehicle = vehicle;
+        s.live = true;
+        liveCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Retire a live handle; returns the slot's next handle, free for reuse
+    VehicleHandle retire(VehicleHandle h) {
+        Slot& s = slot(h);
+        s.live = false;
+        ++s.generation;
+        liveCount.fetch_sub(1, std::memory_order_relaxed);
+        return (h & slotMask) | static_cast<VehicleHandle>(s.generation) << slotBits;
+    }
+
+    bool isLive(VehicleHandle h) const {
+        if (!chunks || !chunks[(h & slotMask) >> chunkBits].load(std::memory_order_acquire)) return false;
+        const Slot& s = slot(h);
+        return s.live && s.generation == h >> slotBits;
+    }
+
+    Vehicle& operator[](VehicleHandle h) { return slot(h).vehicle; }
+    const Vehicle& operator[](VehicleHandle h) const { return slot(h).vehicle; }
+
+    std::int64_t size() const { return liveCount.load(std::memory_order_relaxed); }
+};
+
+// Pedestrian signal: WALK, the flashing DON'T WALK clearance and the pending request share
+// one atomic byte, so a push button may call requestCrossing() from its own thread while
+// the controller runs
+class PedestrianSignal {
+private:
+    static constexpr std::uint8_t walkBit = 1, requestBit = 2, clearanceBit = 4;
+    std::atomic<std::uint8_t> bits;
+
+public:
+    PedestrianSignal() : bits(0) {}
+    PedestrianSignal(const PedestrianSignal& other) : bits(other.bits.load(std::memory_order_relaxed)) {}
+    PedestrianSignal& operator=(const PedestrianSignal& other) {
+        bits.store(other.bits.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return *this;
+    }
+
+    void requestCrossing() { bits.fetch_or(requestBit, std::memory_order_release); }
+    void grantCrossing() { bits.store(walkBit, std::memory_order_release); }
+    // Flashing is set before WALK clears, so a reader never sees DONT_WALK in between
+    void startClearance() {
+        bits.fetch_or(clearanceBit, std::memory_order_release);
+        bits.fetch_and(static_cast<std::uint8_t>(~walkBit), std::memory_order_release);
+    }
+    void endCrossing() { bits.fetch_and(static_cast<std::uint8_t>(~(walkBit | clearanceBit)), std::memory_order_release); }
+
+    bool isRequested() const { return bits.load(std::memory_order_acquire) & requestBit; }
+    PedestrianState getState() const {
+        std::uint8_t b = bits.load(std::memory_order_acquire);
+        return b & walkBit ? WALK : b & clearanceBit ? FLASHING_DONT_WALK : DONT_WALK;
+    }
+};
+
+// Vehicle queue: growable ring buffer with each vehicle field in its own contiguous array,
+// allocated on the first push so idle lanes of large networks cost no memory
+class VehicleQueue {
+private:
+    std::vector<VehicleHandle> handles;
+    std::vector<long long> arrivals;        // arrival timestamps in clock ticks
+    std::vector<unsigned char> emergency;
+    std::size_t head, count, mask;          // capacity is always a power of two
+    static constexpr std::size_t initialCapacity = 16;
+
+    void grow() {
+        std::size_t capacity = handles.size(), newCapacity = capacity ? capacity * 2 : initialCapacity;
+        std::vector<VehicleHandle> newHandles(newCapacity);
+        std::vector<long long> newArrivals(newCapacity);
+        std::vector<unsigned char> newEmergency(newCapacity);
+        for (std::size_t i = 0; i < count; ++i) {
+            std::size_t slot = (head + i) & mask;
+            newHandles[i] = handles[slot];
+            newArrivals[i] = arrivals[slot];
+            newEmergency[i] = emergency[slot];
+        }
+        handles.swap(newHandles);
+        arrivals.swap(newArrivals);
+        emergency.swap(newEmergency);
+        head = 0;
+        mask = newCapacity - 1;
+    }
+
+public:
+    VehicleQueue() : head(0), count(0), mask(0) {}
+
+    void push(VehicleHandle vehicle, long long arrival, bool isEmergency) {
+        if (count == handles.size()) grow();
+        std::size_t slot = (head + count) & mask;
+        handles[slot] = vehicle;
+        arrivals[slot] = arrival;
+        emergency[slot] = isEmergency;
+        ++count;
+    }
+
+    void pop() {
+        head = (head + 1) & mask;
+        --count;
+    }
+
+    bool empty() const { return count == 0; }
+    std::size_t size() const { return count; }
+    std::size_t capacity() const { return handles.size(); }
+
+    // i counts from the front of the queue
+    VehicleHandle handleAt(std::size_t i) const { return handles[(head + i) & mask]; }
+    long long arrivalAt(std::size_t i) const { return arrivals[(head + i) & mask]; }
+    bool emergencyAt(std::size_t i) const { return emergency[(head + i) & mask] != 0; }
+};
+
+// Traffic lane: the queue for one turn on one approach. It holds vehicle handles with
+// the time each joined this lane; the vehicle records stay put in their arena.
+class TrafficLane {
+private:
+    int approach;
+    int turn;
+    const SimulationClock* clock;
+    VehicleQueue vehicles;
+    int trafficDensity;
+
+    // Running aggregates so lane queries never walk the queue. Arrivals are summed
+    // relative to a base that resets whenever the lane empties, so the sum stays
+    // bounded by queue length times queue age however long the run is.
+    long long arrivalBase;       // clock ticks
+    long long arrivalTimeSum;    // sum of queued (arrival - arrivalBase), in clock ticks
+    int emergencyCount;
+
+public:
+    TrafficLane() : TrafficLane(0, nullptr) {}
+    TrafficLane(int approachIndex, const SimulationClock& simClock, int turnIndex = THROUGH) : TrafficLane(approachIndex, &simClock, turnIndex) {}
+    TrafficLane(int approachIndex, const SimulationClock* simClock, int turnIndex = THROUGH)
+        : approach(approachIndex), turn(turnIndex), clock(simClock), trafficDensity(5), arrivalBase(0), arrivalTimeSum(0), emergencyCount(0) {}
+
+    void addVehicle(VehicleHandle vehicle, SimulationClock::time_point arrivalTime, bool isEmergency = false) {
+        long long arrival = arrivalTime.time_since_epoch().count();
+        if (vehicles.empty()) {
+            arrivalBase = arrival;
+            arrivalTimeSum = 0;
+        }
+        vehicles.push(vehicle, arrival, isEmergency);
+        arrivalTimeSum += arrival - arrivalBase;
+        if (isEmergency) ++emergencyCount;
+    }
+    bool hasVehicles() const { return !vehicles.empty(); }
+    int getQueueLength() const { return vehicles.size(); }
+
+    VehicleHandle processVehicle() {
+        VehicleHandle v = frontVehicle();
+        arrivalTimeSum -= vehicles.arrivalAt(0) - arrivalBase;
+        if (vehicles.emergencyAt(0)) --emergencyCount;
+        vehicles.pop();
+        return v;
+    }
+
+    // Sum of queued arrival times in clock ticks
+    long long getArrivalTimeTotal() const { return static_cast<long long>(vehicles.size()) * arrivalBase + arrivalTimeSum; }
+
+    // Total wait is n * now - sum(arrival)
+    SimulationClock::duration getTotalWaitTime() const {
+        if (vehicles.empty()) return SimulationClock::duration::zero();
+        long long sinceBase = clock->now().time_since_epoch().count() - arrivalBase;
+        return SimulationClock::duration(static_cast<long long>(vehicles.size()) * sinceBase - arrivalTimeSum);
+    }
+
+    // Seconds, at full clock resolution
+    double getAverageWaitTime() const {
+        if (vehicles.empty()) return 0;
+        return std::chrono::duration<double>(getTotalWaitTime()).count() / vehicles.size();
+    }
+
+    int getApproach() const { return approach; }
+    int getTurn() const { return turn; }
+    void setTrafficDensity(int d) { trafficDensity = std::clamp(d, 0, 10); }
+    int getTrafficDensity() const { return trafficDensity; }
+
+    bool hasEmergencyVehicle() const { return emergencyCount > 0; }
+
+    VehicleHandle frontVehicle() const {
+        if (vehicles.empty()) throw std::runtime_error("No vehicles to process");
+        return vehicles.handleAt(0);
+    }
+    // i counts from the front of the queue
+    VehicleHandle vehicleAt(int i) const { return vehicles.handleAt(i); }
+    SimulationClock::time_point arrivalTimeAt(int i) const { return SimulationClock::time_point(SimulationClock::duration(vehicles.arrivalAt(i))); }
+    // When the front vehicle joined this lane
+    SimulationClock::time_point frontArrivalTime() const {
+        if (vehicles.empty()) throw std::runtime_error("No vehicles to process");
+        return SimulationClock::time_point(SimulationClock::duration(vehicles.arrivalAt(0)));
+    }
+};
+
+// Signal timing plan, in seconds
+struct SignalTiming {
+    int baseGreenTime = 20;
+    int yellowTime = 3;
+    int minGreenTime = 10;
+    int maxGreenTime = 60;
+};
+
+// Pedestrian interval, run alongside the green of a phase that crossing walks with: WALK,
+// then flashing DON'T WALK long enough to finish crossing, both inside that green
+struct PedestrianTiming {
+    int walkSeconds = 4;         // the usual minimum where pedestrian volumes are light
+    int clearanceSeconds = 8;    // about 10 m of crosswalk at 1.2 m/s
+
+    int intervalSeconds() const { return walkSeconds + clearanceSeconds; }
+};
+
+// Saturation-flow discharge of a queue through one green. Once the start-up lost time
+// has passed, vehicles enter one saturation headway apart, and the queue keeps moving
+// into the first part of the yellow. A vehicle needs a whole headway inside that
+// effective green, so how many get through is a closed form in the interval lengths.
+struct DischargeModel {
+    double startupLostSeconds = 2;
+    double saturationHeadwaySeconds = 2;    // 1800 vehicles per hour of effective green
+    double yellowUsedSeconds = 2;           // capped at the yellow's length
+
+    double effectiveGreen(double greenSeconds, double yellowSeconds) const {
+        return greenSeconds + std::min(yellowUsedSeconds, yellowSeconds) - startupLostSeconds;
+    }
+    // Departures from a queue that outlasts the interval
+    int departures(double greenSeconds, double yellowSeconds) const {
+        double effective = effectiveGreen(greenSeconds, yellowSeconds);
+        return effective > 0 ? static_cast<int>(std::floor(effective / saturationHeadwaySeconds + 1e-9)) : 0;
+    }
+    // Shortest whole-second green that clears `vehicles`; none for an empty queue
+    int greenFor(int vehicles, double yellowSeconds) const {
+        if (vehicles <= 0) return 0;
+        double green = startupLostSeconds + vehicles * saturationHeadwaySeconds - std::min(yellowUsedSeconds, yellowSeconds);
+        return std::max(0, static_cast<int>(std::ceil(green - 1e-9)));
+    }
+    // When the k-th vehicle, counting from 0, enters after the green starts
+    double departureTime(int k) const { return startupLostSeconds + k * saturationHeadwaySeconds; }
+};
+
+// Traffic signal: one light per movement, driven a phase at a time and packed as a
+// green and a yellow mask; a movement in neither is red
+class TrafficSignal {
+private:
+    int currentPhase;
+    MovementMask greenMovements, yellowMovements;
+    int baseGreenTime, yellowTime, minGreenTime, maxGreenTime;
+
+public:
+    explicit TrafficSignal(const SignalTiming& timing = SignalTiming()) : currentPhase(-1), greenMovements(0), yellowMovements(0) { setTiming(timing); }
+
+    // Lights stay as they are; the new plan applies from the next change
+    void setTiming(const SignalTiming& timing) {
+        if (timing.yellowTime < 0 || timing.minGreenTime < 0 || timing.baseGreenTime < 0) throw std::invalid_argument("Signal times cannot be negative");
+        baseGreenTime = timing.baseGreenTime;
+        yellowTime = timing.yellowTime;
+        minGreenTime = timing.minGreenTime;
+        maxGreenTime = std::max(timing.minGreenTime, timing.maxGreenTime);
+    }
+    void setBaseGreenTime(int seconds) { setTiming(SignalTiming{ seconds, yellowTime, minGreenTime, maxGreenTime }); }
+    void setYellowTime(int seconds) { setTiming(SignalTiming{ baseGreenTime, seconds, minGreenTime, maxGreenTime }); }
+    void setMinGreenTime(int seconds) { setTiming(SignalTiming{ baseGreenTime, yellowTime, seconds, maxGreenTime }); }
+    void setMaxGreenTime(int seconds) { setTiming(SignalTiming{ baseGreenTime, yellowTime, minGreenTime, seconds }); }
+    SignalTiming getTiming() const { return SignalTiming{ baseGreenTime, yellowTime, minGreenTime, maxGreenTime }; }
+
+    // Movements shared by both phases stay green through the change
+    void changePhase(int phase, MovementMask movements) {
+        currentPhase = phase;
+        greenMovements = movements;
+        yellowMovements = 0;
+    }
+
+    // Clear the green movements that the next phase does not keep; returns them, empty if none
+    MovementMask setYellow(MovementMask next) {
+        MovementMask ending = greenMovements & ~next;
+        greenMovements &= next;
+        yellowMovements |= ending;
+        return ending;
+    }
+
+    LightState getLightState(int movement) const {
+        return greenMovements >> movement & 1 ? GREEN : yellowMovements >> movement & 1 ? YELLOW : RED;
+    }
+    bool isGreen(int movement) const { return greenMovements >> movement & 1; }
+    MovementMask getGreenMovements() const { return greenMovements; }
+    MovementMask getYellowMovements() const { return yellowMovements; }
+    int getCurrentPhase() const { return currentPhase; }
+    int getYellowTime() const { return yellowTime; }
+    int getBaseGreenTime() const { return baseGreenTime; }
+    int getMinGreenTime() const { return minGreenTime; }
+    int getMaxGreenTime() const { return maxGreenTime; }
+
+    int calculateAdaptiveGreenTime(const TrafficLane& lane) const {
+        int time = baseGreenTime + lane.getQueueLength() * 2 + lane.getTrafficDensity() * 2;
+        return std::clamp(time, minGreenTime, maxGreenTime);
+    }
+};
+
+// What a monitoring reader sees: every light and crossing packed into a few words
+struct SignalSnapshot {
+    MovementMask green = 0, yellow = 0;    // movements in neither are red
+    std::int64_t time = 0;                 // controller clock at the last change, in ns
+    std::uint32_t cycle = 0;
+    std::int8_t phase = -1;
+    std::uint8_t pedestrianWalk = 0, pedestrianClearance = 0, pedestrianRequest = 0;    // one bit per approach
+
+    LightState light(int movement) const { return green >> movement & 1 ? GREEN : yellow >> movement & 1 ? YELLOW : RED; }
+    PedestrianState pedestrian(int approach) const {
+        return pedestrianWalk >> approach & 1 ? WALK : pedestrianClearance >> approach & 1 ? FLASHING_DONT_WALK : DONT_WALK;
+    }
+    bool crossingRequested(int approach) const { return pedestrianRequest >> approach & 1; }
+};
+static_assert(sizeof(SignalSnapshot) == 32 && std::is_trivially_copyable<SignalSnapshot>::value, "snapshots copy as whole words");
+
+// Single-writer sequence lock: the writer never waits, and a reader retries while a
+// write is in flight. The payload is held in relaxed atomic words, so a torn copy is
+// detected and discarded rather than being undefined behaviour.
+template <typename T>
+class SeqLock {
+private:
+    static_assert(std::is_trivially_copyable<T>::value && sizeof(T) % sizeof(std::uint64_t) == 0, "payload must copy as whole words");
+    static constexpr std::size_t words = sizeof(T) / sizeof(std::uint64_t);
+
+    alignas(64) std::atomic<std::uint64_t> sequence;    // odd while a write is in flight
+    std::array<std::atomic<std::uint64_t>, words> data;
+
+public:
+    SeqLock() : sequence(0) { store(T()); }
+
+    void store(const T& value) {
+        std::uint64_t raw[words];
+        std::memcpy(raw, &value, sizeof(T));
+        std::uint64_t s = sequence.load(std::memory_order_relaxed);
+        sequence.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (std::size_t i = 0; i < words; ++i) data[i].store(raw[i], std::memory_order_relaxed);
+        sequence.store(s + 2, std::memory_order_release);
+    }
+
+    T load() const {
+        std::uint64_t raw[words];
+        for (;;) {
+            std::uint64_t before = sequence.load(std::memory_order_acquire);
+            if (before & 1) continue;
+            for (std::size_t i = 0; i < words; ++i) raw[i] = data[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sequence.load(std::memory_order_relaxed) == before) break;
+        }
+        T value;
+        std::memcpy(&value, raw, sizeof(T));
+        return value;
+    }
+};
+
+// Counter-based random stream: every draw is a pure function of (seed, stream, counter),
+// so results do not depend on how replicas or intersections are spread over threads
+class RandomStream {
+private:
+    std::uint64_t key;
+    std::uint64_t counter;
+
+    // SplitMix64 finalizer
+    static std::uint64_t mix(std::uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+public:
+    RandomStream(std::uint64_t seed = 0, std::uint64_t streamId = 0)
+        : key(mix(mix(seed) + 0x9E3779B97F4A7C15ULL * (streamId + 1))), counter(0) {}
+
+    // Derive an independent seed, e.g. one per intersection of a network
+    static std::uint64_t deriveSeed(std::uint64_t seed, std::uint64_t index) { return mix(seed ^ mix(index + 1)); }
+
+    std::uint64_t next() { return mix(key + 0x9E3779B97F4A7C15ULL * counter++); }
+
+    // Uniform integer in [0, n) by multiply-shift instead of a modulo
+    std::uint32_t below(std::uint32_t n) { return static_cast<std::uint32_t>(((next() >> 32) * n) >> 32); }
+    bool oneIn(std::uint32_t n) { return below(n) == 0; }
+    double uniform() { return (next() >> 11) * 0x1.0p-53; }
+    double exponential(double rate) { return -std::log1p(-uniform()) / rate; }
+
+    std::uint64_t position() const { return counter; }
+};
+
+// Stream ids per approach: 0-3 lane draws, 4-7 pedestrians and 8-11 arrival processes
+// as on a 4-way junction; further approaches continue from 16
+enum StreamKind { STREAM_LANE, STREAM_PEDESTRIAN, STREAM_ARRIVAL };
+constexpr std::uint64_t approachStreamId(StreamKind kind, int approach) {
+    return approach < 4 ? kind * 4 + approach : 16 + 3 * (approach - 4) + kind;
+}
+
+// Binary checkpoint of a paused event-driven run: a 16-byte header, then the
+// scheduler's pending events and the controller's state as packed fields. It is
+// only read back by the same build, so fields are written in native layout.
+struct CheckpointHeader {
+    char magic[8];
+    std::uint16_t version;
+    std::uint16_t approaches;
+    std::uint32_t reserved;
+};
+static_assert(sizeof(CheckpointHeader) == 16, "checkpoint header is fixed width");
+
+constexpr char checkpointMagic[8] = { 'T', 'L', 'C', 'S', 'T', 'A', 'T', 'E' };
+
+class CheckpointWriter {
+private:
+    std::vector<unsigned char> data;
+
+public:
+    explicit CheckpointWriter(int approaches);
+
+    template <typename T>
+    void write(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "checkpoint fields copy as bytes");
+        const unsigned char* raw = reinterpret_cast<const unsigned char*>(&value);
+        data.insert(data.end(), raw, raw + sizeof(T));
+    }
+
+    const std::vector<unsigned char>& bytes() const { return data; }
+
+    void save(const std::string& path) const;
+};
+
+// Reads a checkpoint in place, e.g. from a MappedFile or a writer's bytes
+class CheckpointReader {
+private:
+    const unsigned char* next;
+    const unsigned char* last;
+    int legs;
+
+public:
+    CheckpointReader(const unsigned char* data, std::size_t size);
+    explicit CheckpointReader(const std::vector<unsigned char>& data) : CheckpointReader(data.data(), data.size()) {}
+
+    template <typename T>
+    T read() {
+        static_assert(std::is_trivially_copyable<T>::value, "checkpoint fields copy as bytes");
+        if (static_cast<std::size_t>(last - next) < sizeof(T)) throw std::runtime_error("Truncated checkpoint");
+        T value;
+        std::memcpy(&value, next, sizeof(T));
+        next += sizeof(T);
+        return value;
+    }
+
+    int approaches() const { return legs; }
+    std::size_t remaining() const { return static_cast<std::size_t>(last - next); }
+};
+
+// Discrete-event scheduler: time-ordered queue of simulation events.
+// LINK_ARRIVAL carries a vehicle handed over from an upstream intersection.
+// `index` is the movement lane for ARRIVAL and DEPARTURE (-1 on ARRIVAL lets the
+// controller pick the turn) and the signal phase for the phase-change events.
+enum EventType { ARRIVAL, CYCLE_START, YELLOW_START, GREEN_START, PEDESTRIAN_START, PEDESTRIAN_END, DEPARTURE, LINK_ARRIVAL,
+                 SENSOR_ARRIVAL, PEDESTRIAN_REQUEST, PEDESTRIAN_CLEARANCE };
+
+struct Event {
+    SimulationClock::time_point time;
+    unsigned long long sequence;    // tie-break so same-time events run in scheduling order
+    EventType type;
+    int approach;
+    int index;
+    VehicleHandle vehicle;    // LINK_ARRIVAL only
+    bool emergency;
+    std::uint32_t green;      // DEPARTURE and the pedestrian timers: serial of the green they run in
+};
+
+class EventScheduler {
+private:
+    struct Later {
+        bool operator()(const Event& a, const Event& b) const {
+            return a.time != b.time ? a.time > b.time : a.sequence > b.sequence;
+        }
+    };
+
+    VirtualClock& clock;
+    std::priority_queue<Event, std::vector<Event>, Later> events;
+    unsigned long long nextSequence;
+
+public:
+    explicit EventScheduler(VirtualClock& simClock) : clock(simClock), nextSequence(0) {}
+
+    void scheduleAt(SimulationClock::time_point t, EventType type, int approach = 0, VehicleHandle vehicle = 0, bool emergency = false, int index = 0,
+                    std::uint32_t green = 0) {
+        events.push(Event{ std::max(t, clock.now()), nextSequence++, type, approach, index, vehicle, emergency, green });
+    }
+    void schedule(SimulationClock::duration delay, EventType type, int index = 0) {
+        scheduleAt(clock.now() + delay, type, NORTH, 0, false, index);
+    }
+
+    bool empty() const { return events.empty(); }
+    std::size_t pending() const { return events.size(); }
+
+    // The clock, the pending events and the sequence counter; restoring replaces them all
+    void saveState(CheckpointWriter& out) const;
+    void restoreState(CheckpointReader& in);
+    SimulationClock::time_point nextEventTime() const { return events.top().time; }
+
+    // Dispatch every event due by `end`, moving the clock to each event's timestamp first
+    template <typename Handler>
+    std::size_t runUntil(SimulationClock::time_point end, Handler&& handler) {
+        std::size_t dispatched = 0;
+        while (!events.empty() && events.top().time <= end) {
+            Event e = events.top();
+            events.pop();
+            clock.advanceTo(e.time);
+            handler(e);
+            ++dispatched;
+        }
+        clock.advanceTo(end);
+        return dispatched;
+    }
+};
+
+// Name table shared by the controller and the logger
+inline const char* directionName(Direction d) {
+    switch (d) {
+    case NORTH: return "North";
+    case EAST: return "East";
+    case SOUTH: return "South";
+    case WEST: return "West";
+    default: return "Unknown";
+    }
+}
+
+// Compass names on junctions of up to four approaches, numbered legs beyond that
+inline const char* approachName(int approaches, int approach) {
+    static const char* const legs[maxApproaches] = { "Leg 1", "Leg 2", "Leg 3", "Leg 4", "Leg 5", "Leg 6", "Leg 7", "Leg 8" };
+    if (approach < 0 || approach >= maxApproaches) return "Unknown";
+    return approaches <= 4 ? directionName(static_cast<Direction>(approach)) : legs[approach];
+}
+
+inline const char* turnName(int approaches, int turn) {
+    int k = turnOffset(approaches, turn), skew = 2 * k - approaches;
+    if (skew == 0) return "Through";
+    if (skew < 0) return k == 1 && approaches > 4 ? "Sharp Left" : "Left";
+    return k == approaches - 1 && approaches > 4 ? "Sharp Right" : "Right";
+}
+
+// Asynchronous logger. Producers push small structured records into a lock-free ring;
+// a background thread does all the formatting and console I/O.
+enum LogLevel { LOG_OFF, LOG_SUMMARY, LOG_CYCLE, LOG_VEHICLE };
+enum LogMessage { MSG_CYCLE_HEADER, MSG_QUEUE_HEADER, MSG_LANE_STATUS, MSG_EMERGENCY, MSG_YELLOW, MSG_GREEN,
+                  MSG_PEDESTRIAN_WALK, MSG_PEDESTRIAN_CLEARANCE, MSG_VEHICLE_PASSED, MSG_TOTAL_PASSED, MSG_STATS, MSG_FINAL_STATS };
+
+// Phase messages carry the phase's approach, paired approach (in b) and turn
+struct LogRecord {
+    LogMessage message;
+    int approach;
+    bool flag;
+    long long a;
+    int b;             // paired approach for MSG_YELLOW/MSG_GREEN, density for MSG_LANE_STATUS
+    double value;
+    int turn = 0;
+    int approaches = 4;
+};
+
+class Logger {
+private:
+    // Bounded multi-producer queue (Vyukov): a cell is free for position p when its sequence equals p
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        LogRecord record;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    std::size_t mask;
+    alignas(64) std::atomic<std::size_t> enqueuePos;
+    alignas(64) std::size_t dequeuePos;                // consumer thread only
+    std::atomic<std::size_t> written;                  // records formatted and handed to the stream
+    std::atomic<bool> stopping;
+    std::FILE* out;
+    std::thread drainThread;
+
+    bool tryPush(const LogRecord& r);
+    bool tryPop(LogRecord& r);
+    static void formatPhase(const LogRecord& r, char* name, std::size_t size);
+    static void format(const LogRecord& r, std::string& buffer);
+    void drainLoop();
+
+public:
+    explicit Logger(std::FILE* output = stdout, std::size_t minCapacity = 1 << 16);
+    ~Logger();
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    static Logger& global();
+
+    // Only waits when the ring is full, i.e. the output cannot keep up
+    void write(const LogRecord& r);
+
+    // Block until everything logged so far has reached the stream
+    void flush();
+};
+
+// Hot-path instrumentation: scoped phase timers and HDR-style log-bucketed histograms
+enum Phase { PHASE_GENERATE_TRAFFIC, PHASE_SELECT_DIRECTION, PHASE_SIGNAL_CHANGE, PHASE_PROCESS_VEHICLES, PHASE_COUNT };
+
+inline const char* phaseName(Phase p) {
+    switch (p) {
+    case PHASE_GENERATE_TRAFFIC: return "generateTraffic";
+    case PHASE_SELECT_DIRECTION: return "findNextPhase";
+    case PHASE_SIGNAL_CHANGE: return "signalChange";
+    case PHASE_PROCESS_VEHICLES: return "processVehicles";
+    default: return "unknown";
+    }
+}
+
+inline int highestBit(std::uint64_t v) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, v);
+    return static_cast<int>(index);
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+
+inline int lowestBit(std::uint64_t v) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, v);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(v);
+#endif
+}
+
+// Bucket layout: exact below 32, then 32 linear sub-buckets per power of two (< 3.2% error)
+struct HistogramBuckets {
+    static constexpr int subBucketBits = 5;
+    static constexpr std::size_t subBuckets = std::size_t(1) << subBucketBits;
+    static constexpr std::size_t count = (64 - subBucketBits + 1) * subBuckets;
+
+    static std::size_t indexOf(std::uint64_t v) {
+        if (v < subBuckets) return static_cast<std::size_t>(v);
+        int shift = highestBit(v) - subBucketBits;
+        return (shift + 1) * subBuckets + static_cast<std::size_t>((v >> shift) - subBuckets);
+    }
+
+    // Midpoint of the values that land in bucket i
+    static std::uint64_t valueAt(std::size_t i) {
+        if (i < subBuckets) return i;
+        int shift = static_cast<int>(i / subBuckets) - 1;
+        std::uint64_t lower = static_cast<std::uint64_t>(i % subBuckets + subBuckets) << shift;
+        return lower + ((std::uint64_t(1) << shift) >> 1);
+    }
+};
+
+// Plain copy of one or more histograms, used for merging and reporting
+struct HistogramSnapshot {
+    std::vector<std::uint64_t> counts;
+    std::uint64_t total = 0, maxValue = 0;
+    double sum = 0;
+
+    HistogramSnapshot() : counts(HistogramBuckets::count) {}
+
+    void merge(const HistogramSnapshot& other) {
+        for (std::size_t i = 0; i < counts.size(); ++i) counts[i] += other.counts[i];
+        total += other.total;
+        sum += other.sum;
+        maxValue = std::max(maxValue, other.maxValue);
+    }
+
+    double mean() const { return total ? sum / total : 0; }
+
+    std::uint64_t percentile(double p) const {
+        if (!total) return 0;
+        std::uint64_t rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(p / 100.0 * total)));
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < counts.size(); ++i) {
+            seen += counts[i];
+            if (seen >= rank) return std::min(HistogramBuckets::valueAt(i), maxValue);
+        }
+        return maxValue;
+    }
+};
+
+// Written by one thread, readable from any thread while it records
+class LatencyHistogram {
+private:
+    std::array<std::atomic<std::uint64_t>, HistogramBuckets::count> counts{};
+    std::atomic<std::uint64_t> total{ 0 }, maxValue{ 0 };
+    std::atomic<double> sum{ 0 };
+
+    static void bump(std::atomic<std::uint64_t>& c, std::uint64_t by = 1) {
+        c.store(c.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);    // single writer: no locked add
+    }
+
+public:
+    void record(std::uint64_t v) {
+        bump(counts[HistogramBuckets::indexOf(v)]);
+        bump(total);
+        sum.store(sum.load(std::memory_order_relaxed) + static_cast<double>(v), std::memory_order_relaxed);
+        if (v > maxValue.load(std::memory_order_relaxed)) maxValue.store(v, std::memory_order_relaxed);
+    }
+
+    void addTo(HistogramSnapshot& out) const {
+        for (std::size_t i = 0; i < counts.size(); ++i) out.counts[i] += counts[i].load(std::memory_order_relaxed);
+        out.total += total.load(std::memory_order_relaxed);
+        out.sum += sum.load(std::memory_order_relaxed);
+        out.maxValue = std::max(out.maxValue, maxValue.load(std::memory_order_relaxed));
+    }
+};
+
+struct MetricsSnapshot {
+    std::array<HistogramSnapshot, PHASE_COUNT> phaseLatency;    // ns per call
+    std::array<HistogramSnapshot, maxApproaches> waitTime;      // ns per discharged vehicle, by approach
+};
+
+// Per-thread histograms, merged only when someone asks for a snapshot
+class Instrumentation {
+private:
+    struct ThreadMetrics {
+        std::array<LatencyHistogram, PHASE_COUNT> phaseLatency;
+        std::array<LatencyHistogram, maxApproaches> waitTime;
+
+        ThreadMetrics() {
+            std::lock_guard<std::mutex> lock(registryMutex());
+            registry().push_back(this);
+        }
+
+        // Fold a finished thread's counts into the retired totals
+        ~ThreadMetrics() {
+            std::lock_guard<std::mutex> lock(registryMutex());
+            auto& threads = registry();
+            threads.erase(std::remove(threads.begin(), threads.end(), this), threads.end());
+            addTo(retired());
+        }
+
+        void addTo(MetricsSnapshot& out) const {
+            for (int p = 0; p < PHASE_COUNT; ++p) phaseLatency[p].addTo(out.phaseLatency[p]);
+            for (int d = 0; d < maxApproaches; ++d) waitTime[d].addTo(out.waitTime[d]);
+        }
+    };
+
+    static std::mutex& registryMutex();
+    static std::vector<ThreadMetrics*>& registry();
+    static MetricsSnapshot& retired();
+    static std::atomic<bool>& enabledFlag() {
+        static std::atomic<bool> flag{ false };
+        return flag;
+    }
+
+    // Allocated on first use so threads that never record pay nothing
+    static ThreadMetrics& local();
+
+public:
+    static bool enabled() { return enabledFlag().load(std::memory_order_relaxed); }
+    static void setEnabled(bool on) { enabledFlag().store(on, std::memory_order_relaxed); }
+
+    static void recordPhase(Phase p, std::uint64_t ns) { local().phaseLatency[p].record(ns); }
+    static void recordWait(int approach, std::uint64_t ns) { local().waitTime[approach].record(ns); }
+
+    static MetricsSnapshot snapshot();
+    static void exportText(std::ostream& os);
+
+    // Prometheus text format; latencies are of the controller's own code, not the traffic
+    static void exportPrometheus(std::ostream& os);
+};
+
+// Live metrics of one controller for scraping while it runs. The control thread is the
+// only writer, so each update is a relaxed load and store with no locked instruction;
+// a reader on any thread sees every value whole, if a moment stale.
+class ControllerMetrics {
+private:
+    struct ApproachMetrics {
+        std::atomic<std::int64_t> queued{ 0 };
+        std::atomic<std::uint64_t> departures{ 0 };
+        LatencyHistogram wait;    // ns per discharged vehicle
+    };
+    struct PhaseMetrics {
+        std::atomic<std::uint64_t> count{ 0 };
+        std::atomic<std::int64_t> nanoseconds{ 0 };
+    };
+
+    int approaches;
+    std::vector<ApproachMetrics> perApproach;
+    std::vector<PhaseMetrics> perPhase;
+    std::atomic<std::uint64_t> cycles, preemptions;
+    std::atomic<std::int64_t> maxPreemptionNs, currentPhase;
+    SimulationClock::time_point greenStart;    // writer only
+    int greenPhase;
+
+    template <typename T>
+    static void add(std::atomic<T>& c, T by) { c.store(c.load(std::memory_order_relaxed) + by, std::memory_order_relaxed); }
+
+public:
+    ControllerMetrics(int approachCount, int phaseCount)
+        : approaches(approachCount), perApproach(approachCount), perPhase(phaseCount), cycles(0), preemptions(0),
+          maxPreemptionNs(0), currentPhase(-1), greenPhase(-1) {}
+
+    ControllerMetrics(const ControllerMetrics&) = delete;
+    ControllerMetrics& operator=(const ControllerMetrics&) = delete;
+
+    void setQueue(int approach, int vehicles) { perApproach[approach].queued.store(vehicles, std::memory_order_relaxed); }
+    void recordDeparture(int approach, std::uint64_t waitNs) {
+        add<std::uint64_t>(perApproach[approach].departures, 1);
+        perApproach[approach].wait.record(waitNs);
+    }
+    void recordCycle() { add<std::uint64_t>(cycles, 1); }
+    // A phase lasts from its green to the next green, yellow and pauses included
+    void recordGreen(int phase, SimulationClock::time_point now) {
+        if (greenPhase >= 0) {
+            add<std::uint64_t>(perPhase[greenPhase].count, 1);
+            add<std::int64_t>(perPhase[greenPhase].nanoseconds, std::chrono::duration_cast<std::chrono::nanoseconds>(now - greenStart).count());
+        }
+        greenPhase = phase;
+        greenStart = now;
+        currentPhase.store(phase, std::memory_order_relaxed);
+    }
+    void recordPreemption(SimulationClock::duration latency) {
+        add<std::uint64_t>(preemptions, 1);
+        std::int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+        if (ns > maxPreemptionNs.load(std::memory_order_relaxed)) maxPreemptionNs.store(ns, std::memory_order_relaxed);
+    }
+
+    // Waits of every discharged vehicle, all approaches together
+    HistogramSnapshot waitTimes() const;
+
+    // Prometheus text exposition format, version 0.0.4
+    void exportPrometheus(std::ostream& os) const;
+};
+
+// Minimal HTTP server for Prometheus scrapes: one thread that takes a connection at a
+// time, answers GET /metrics with `render`'s text and closes it. Rendering reads only
+// atomics, so a scrape never waits on the control thread or slows it down. Reading the
+// request and sending the response are both bounded in time, so a stalled scraper
+// holds the thread for a few seconds at most.
+class MetricsServer {
+private:
+#ifdef _WIN32
+    using Socket = std::uintptr_t;    // SOCKET, kept out of the header with winsock2.h
+    static constexpr Socket invalidSocket = ~Socket(0);
+#else
+    using Socket = int;
+    static constexpr Socket invalidSocket = -1;
+#endif
+
+    std::function<void(std::ostream&)> render;
+    Socket listener;
+    int boundPort;
+    std::atomic<bool> running;
+    std::atomic<unsigned long long> scrapes;
+    std::thread thread;
+
+    static void closeSocket(Socket s);
+    static constexpr int sendTimeoutMs = 1000;
+
+    static bool waitReadable(Socket s, int timeoutMs);
+    static void sendAll(Socket s, const std::string& data);
+    void serve(Socket client);
+    void run();
+
+public:
+    // Port 0 picks a free one; see port(). Only local scrapers reach the default address;
+    // "0.0.0.0" listens on every interface.
+    MetricsServer(int port, std::function<void(std::ostream&)> exporter, const std::string& bindAddress = "127.0.0.1");
+    ~MetricsServer();
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    int port() const { return boundPort; }
+    unsigned long long getScrapeCount() const { return scrapes.load(std::memory_order_relaxed); }
+};
+
+// Times the enclosing scope into a phase histogram while instrumentation is enabled
+class ScopedTimer {
+private:
+    Phase phase;
+    bool active;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit ScopedTimer(Phase p) : phase(p), active(Instrumentation::enabled()) {
+        if (active) start = std::chrono::steady_clock::now();
+    }
+
+    ~ScopedTimer() {
+        if (active)
+            Instrumentation::recordPhase(phase, std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+};
+
+// Read-only memory-mapped view of a whole file or of a window into it
+class MappedFile {
+private:
+    const unsigned char* view;     // start of the mapping, aligned down to the OS granularity
+    const unsigned char* bytes;    // requested offset within the view
+    std::size_t length, viewLength;
+#ifdef _WIN32
+    void* file;       // HANDLEs, kept out of the header with windows.h
+    void* mapping;
+#endif
+
+    void map(const std::string& path, std::uint64_t offset, std::size_t requested, bool toEnd);
+
+public:
+    explicit MappedFile(const std::string& path);
+    MappedFile(const std::string& path, std::uint64_t offset, std::size_t windowBytes);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const unsigned char* data() const { return bytes; }
+    std::size_t size() const { return length; }
+
+    static std::uint64_t fileSize(const std::string& path);
+    static std::uint64_t granularity();
+};
+
+// Sequential reader over a file of any size that keeps only one mapped window resident
+class ChunkedFileReader {
+private:
+    std::string path;
+    std::uint64_t fileLength, windowStart, position;
+    std::size_t windowBytes;
+    std::unique_ptr<MappedFile> window;
+
+    // Make sure at least `need` bytes from `position` are mapped (less only at end of file)
+    bool ensure(std::size_t need);
+
+public:
+    explicit ChunkedFileReader(const std::string& filePath, std::size_t chunkBytes = 64u << 20)
+        : path(filePath), fileLength(MappedFile::fileSize(filePath)), windowStart(0), position(0), windowBytes(chunkBytes) {}
+
+    bool atEnd() const { return position >= fileLength; }
+
+    bool read(void* out, std::size_t n) {
+        if (!ensure(n)) return false;
+        std::memcpy(out, window->data() + (position - windowStart), n);
+        position += n;
+        return true;
+    }
+
+    // Next line without its terminator; the view stays valid until the next call
+    bool readLine(const char*& text, std::size_t& n);
+};
+
+// Binary event trace: a 16-byte header followed by fixed-width 32-byte records
+enum TraceEventType : std::uint8_t { TRACE_ARRIVAL, TRACE_DEPARTURE, TRACE_LIGHT_CHANGE, TRACE_PEDESTRIAN_GRANT };
+
+struct TraceRecord {
+    std::int64_t time;           // clock ticks (ns) since the start of the run
+    std::int64_t arrivalTime;    // departures: when the vehicle joined the queue
+    std::uint32_t cycle;
+    std::int32_t vehicleId;      // 0 for signal records
+    std::uint8_t type;           // TraceEventType
+    std::uint8_t approach;
+    std::uint8_t value;          // light changes: the new LightState; vehicles: 1 if emergency
+    std::uint8_t turn;           // version 1 traces leave it zero (THROUGH)
+    std::uint8_t reserved[4];
+};
+static_assert(sizeof(TraceRecord) == 32, "trace records are fixed width");
+
+struct TraceHeader {
+    char magic[8];
+    std::uint16_t version;
+    std::uint16_t approaches;    // 0 in traces before version 3, which were all 4-way
+    std::uint32_t recordSize;
+};
+static_assert(sizeof(TraceHeader) == 16, "trace header is fixed width");
+
+constexpr char traceMagic[8] = { 'T', 'L', 'C', 'T', 'R', 'A', 'C', 'E' };
+
+// Buffers records and writes them in large sequential blocks
+class TraceWriter {
+private:
+    std::string path;
+    std::FILE* file;
+    std::vector<TraceRecord> buffer;
+    std::size_t used;
+    unsigned long long recordCount;
+
+public:
+    explicit TraceWriter(const std::string& tracePath, int approaches = 4, std::size_t bufferRecords = 1 << 16);
+    // Closes the file if close() was not called; a failure then can only be reported on stderr
+    ~TraceWriter();
+
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    void write(const TraceRecord& r) {
+        buffer[used++] = r;
+        ++recordCount;
+        if (used == buffer.size()) flush();
+    }
+
+    // Both throw if the disk is full or the write fails, so a truncated trace never passes
+    // for a complete one
+    void flush();
+    void close();
+
+    unsigned long long records() const { return recordCount; }
+};
+
+// Zero-copy view of a trace file
+class TraceReader {
+private:
+    MappedFile file;
+    const TraceRecord* first;
+    std::size_t count;
+    int legs;
+
+public:
+    explicit TraceReader(const std::string& path);
+
+    const TraceRecord* begin() const { return first; }
+    const TraceRecord* end() const { return first + count; }
+    std::size_t size() const { return count; }
+    int approaches() const { return legs; }
+};
+
+// Offline replay: aggregate a recorded trace without re-running the simulation
+void summarizeTrace(const TraceReader& trace);
+
+// Arrival input. The engine pulls the next arrival for one approach at a time, so
+// sources can stream recorded detector counts without loading them up front.
+struct Arrival {
+    SimulationClock::time_point time;
+    bool emergency;
+    int turn;        // turn index, or -1 to let the controller split by turning shares
+};
+
+class ArrivalSource {
+public:
+    virtual ~ArrivalSource() = default;
+    // Next arrival on `approach`, currently at `density`, at or after `now`; false once its input is exhausted
+    virtual bool nextArrival(int approach, int density, SimulationClock::time_point now, Arrival& out) = 0;
+    // Density 0-10 the source's demand implies at `now`, or -1 to let the controller vary it at random
+    virtual int densityAt(int, SimulationClock::time_point) const { return -1; }
+};
+
+// Synthetic Poisson arrivals: an approach at density d sees on average (d + 1) / 11
+// arrivals per window, the same odds generateTraffic() rolls once per cycle
+class RandomArrivalSource : public ArrivalSource {
+private:
+    std::array<RandomStream, maxApproaches> streams;
+
+public:
+    static constexpr double arrivalWindowSeconds = 10.0;
+
+    explicit RandomArrivalSource(std::uint64_t seed = 0) { reseed(seed); }
+
+    void reseed(std::uint64_t seed) {
+        for (int i = 0; i < maxApproaches; ++i) streams[i] = RandomStream(seed, approachStreamId(STREAM_ARRIVAL, i));
+    }
+
+    void saveState(CheckpointWriter& out) const { out.write(streams); }
+    void restoreState(CheckpointReader& in) { streams = in.read<decltype(streams)>(); }
+
+    bool nextArrival(int approach, int density, SimulationClock::time_point now, Arrival& out) override {
+        RandomStream& stream = streams[approach];
+        double rate = (density + 1) / (11.0 * arrivalWindowSeconds);
+        out.time = now + std::chrono::duration_cast<SimulationClock::duration>(std::chrono::duration<double>(stream.exponential(rate)));
+        out.emergency = stream.oneIn(21);
+        out.turn = -1;
+        return true;
+    }
+};
+
+// Recorded arrivals, one file per approach in time order. Files ending in .csv hold
+// "seconds[,emergency[,turn]]" lines (a non-numeric header line is skipped), where the
+// turn is an index or T/L/R on a 4-way; anything else is a packed array of ArrivalRecord.
+struct ArrivalRecord {
+    std::int64_t time;          // clock ticks (ns) since the start of the run
+    std::uint8_t emergency;
+    std::uint8_t turn;          // turn index + 1; 0 splits by turning shares
+    std::uint8_t reserved[6];
+};
+static_assert(sizeof(ArrivalRecord) == 16, "arrival records are fixed width");
+
+class TraceArrivalSource : public ArrivalSource {
+private:
+    struct LaneInput {
+        std::unique_ptr<ChunkedFileReader> reader;
+        bool csv = false;
+    };
+    std::vector<LaneInput> inputs;
+
+    static bool parseCsv(ChunkedFileReader& reader, Arrival& out);
+
+public:
+    // Empty paths leave that approach without arrivals
+    explicit TraceArrivalSource(const std::vector<std::string>& lanePaths);
+    bool nextArrival(int approach, int, SimulationClock::time_point, Arrival& out) override;
+};
+
+// Arrival rate against time of day, constant from each step to the next and repeating
+// daily from midnight at time zero
+struct DemandProfile {
+    static constexpr double daySeconds = 86400;
+    struct Step {
+        double start;             // seconds since midnight
+        double vehiclesPerHour;
+    };
+    std::vector<Step> steps{ { 0, 327 } };    // RandomArrivalSource's mean rate at density 5
+
+    DemandProfile() = default;
+    explicit DemandProfile(std::vector<Step> profileSteps);
+
+    double rateAt(double seconds) const {
+        double t = std::fmod(seconds, daySeconds);
+        auto next = std::upper_bound(steps.begin(), steps.end(), t, [](double x, const Step& s) { return x < s.start; });
+        return std::prev(next)->vehiclesPerHour;
+    }
+    double stepEnd(std::size_t i) const { return i + 1 < steps.size() ? steps[i + 1].start : daySeconds; }
+
+    // Commuter day: quiet nights, a morning peak inbound on the north-south road and an
+    // evening peak split across all approaches
+    static std::vector<DemandProfile> rushHour(int approaches);
+
+    // CSV of "seconds,vehicles_per_hour[,vehicles_per_hour...]" lines, one rate column per
+    // approach or a single column for all of them (a non-numeric header line is skipped)
+    static std::vector<DemandProfile> load(const std::string& path, int approaches);
+};
+
+// Non-homogeneous Poisson arrivals following one DemandProfile per approach. Arrival
+// times are precomputed in batches by inverting the cumulative rate: unit exponential
+// gaps are drawn into a flat array (a loop the compiler can vectorize), summed, and
+// mapped from expected-vehicle counts back to clock time one profile step at a time.
+class ProfileArrivalSource : public ArrivalSource {
+private:
+    static constexpr std::size_t batchSize = 512;
+
+    struct Lane {
+        DemandProfile profile;
+        std::vector<double> expectedAt;    // expected arrivals from midnight to each step
+        double expectedPerDay = 0;
+        double expected = 0;               // expected arrivals from time zero to the last one drawn
+        RandomStream stream;
+        std::vector<SimulationClock::time_point> times;
+        std::vector<bool> emergencies;
+        std::size_t next = 0;
+    };
+    std::vector<Lane> lanes;
+
+    // Clock time by which `lane` expects `expected` arrivals
+    static double timeAt(const Lane& lane, double expected);
+
+    // Expected arrivals on `lane` from time zero to clock time `seconds`
+    static double expectedBy(const Lane& lane, double seconds);
+    void refill(Lane& lane);
+
+public:
+    // Arrivals start at `start`; each approach draws from its own stream of `seed`
+    ProfileArrivalSource(std::vector<DemandProfile> profiles, std::uint64_t seed = 0, SimulationClock::time_point start = SimulationClock::time_point());
+    bool nextArrival(int approach, int, SimulationClock::time_point, Arrival& out) override {
+        if (approach >= static_cast<int>(lanes.size())) return false;
+        Lane& lane = lanes[approach];
+        if (lane.expectedPerDay <= 0) return false;
+        if (lane.next == lane.times.size()) refill(lane);
+        out.time = lane.times[lane.next];
+        out.emergency = lane.emergencies[lane.next++];
+        out.turn = -1;
+        return true;
+    }
+
+    // The density whose random arrival rate is nearest the profile's
+    int densityAt(int approach, SimulationClock::time_point now) const override;
+};
+
+// Recorded arrivals held in memory, so many simulations can replay them at once
+struct RecordedDemand {
+    std::vector<std::vector<Arrival>> arrivals;    // per approach, in time order
+
+    // Everything before `until`, which must be finite for sources that never run out
+    static RecordedDemand record(ArrivalSource& source, int approaches, SimulationClock::time_point until = SimulationClock::time_point::max());
+};
+
+// One simulation's read position in a RecordedDemand, from `start` on
+class RecordedDemandSource : public ArrivalSource {
+private:
+    const RecordedDemand& demand;
+    std::array<std::size_t, maxApproaches> next{};
+
+public:
+    explicit RecordedDemandSource(const RecordedDemand& recorded, SimulationClock::time_point start = SimulationClock::time_point());
+    bool nextArrival(int approach, int, SimulationClock::time_point, Arrival& out) override {
+        if (approach >= static_cast<int>(demand.arrivals.size()) || next[approach] == demand.arrivals[approach].size()) return false;
+        out = demand.arrivals[approach][next[approach]++];
+        return true;
+    }
+};
+
+// Receives vehicles leaving an intersection by leg `exit`; returns false when there is
+// no room downstream. Accepting takes ownership of the handle: the sink forwards or retires it.
+class DepartureSink {
+public:
+    virtual ~DepartureSink() = default;
+    virtual bool accept(int exit, VehicleHandle vehicle) = 0;
+};
+
+// Signal timing policies. Each picks the next phase and sizes its green from a
+// read-only view of the junction, which is any controller instantiation, told which
+// lanes changed since its last decision. The
+// controller holds one in a std::variant and dispatches once per decision, so the
+// loops over phases and lanes inside a policy are statically bound.
+
+// Default: the phase whose lanes hold the most queued delay, green sized for its critical lane
+struct AdaptivePolicy {
+    static constexpr const char* name = "adaptive";
+    static constexpr bool holdsGreen = false;    // end the green as soon as its queues clear
+    double densityWeight = 0.1;                  // lane score = queue * average wait * (1 + weight * density)
+
+    // Score cache. Queue times average wait is a lane's total wait, n * t - sum(arrivals),
+    // and density is shared by an approach's lanes, so a phase scores the sum over the
+    // approaches it serves of factor * (n * t - arrivals), each term an exact integer
+    // line in t. Those counts and sums only change when a queue does, so a decision
+    // revisits just the dirty lanes and then evaluates one or two terms per phase.
+    struct Term {
+        int approach;
+        MovementMask movements;    // the phase's movements on that approach
+        long long vehicles, arrivals;
+    };
+    std::vector<Term> terms;
+    std::vector<int> phaseTerms;    // phase p owns terms [phaseTerms[p], phaseTerms[p + 1])
+    std::array<long long, maxMovements> laneVehicles{}, laneArrivals{};
+    std::array<double, maxApproaches> factor{};
+    MovementMask queued = 0;
+
+    template <typename Layout>
+    void prime(const Layout& layout) {
+        terms.clear();
+        phaseTerms.assign(1, 0);
+        for (int p = 0; p < layout.phaseCount(); ++p) {
+            for (int a = 0; a < layout.approaches(); ++a) {
+                MovementMask onApproach = layout.phase(p).movements & ((MovementMask(1) << layout.turns()) - 1) << (a * layout.turns());
+                if (onApproach) terms.push_back(Term{ a, onApproach, 0, 0 });
+            }
+            phaseTerms.push_back(static_cast<int>(terms.size()));
+        }
+    }
+
+    template <typename Junction>
+    int selectPhase(const Junction& j, MovementMask dirty) {
+        const auto& layout = j.getLayout();
+        int phases = layout.phaseCount();
+        if (static_cast<int>(phaseTerms.size()) != phases + 1) {
+            prime(layout);
+            dirty = layout.movements() == 64 ? ~MovementMask(0) : (MovementMask(1) << layout.movements()) - 1;
+        }
+
+        if (dirty) {
+            for (MovementMask d = dirty; d; d &= d - 1) {
+                int m = lowestBit(d);
+                const TrafficLane& lane = j.getMovementLane(m);
+                laneVehicles[m] = lane.getQueueLength();
+                laneArrivals[m] = lane.getArrivalTimeTotal();
+                queued = lane.hasVehicles() ? queued | MovementMask(1) << m : queued & ~(MovementMask(1) << m);
+                factor[layout.approachOf(m)] = 1 + lane.getTrafficDensity() * densityWeight;
+            }
+            for (Term& term : terms) {
+                if (!(term.movements & dirty)) continue;
+                term.vehicles = term.arrivals = 0;
+                for (MovementMask served = term.movements; served; served &= served - 1) {
+                    int m = lowestBit(served);
+                    term.vehicles += laneVehicles[m];
+                    term.arrivals += laneArrivals[m];
+                }
+            }
+        }
+
+        // Branch-free argmax; phases with nothing queued score below the floor
+        long long now = j.now().time_since_epoch().count();
+        double maxScore = -1;
+        int best = 0;
+        for (int p = 0; p < phases; ++p) {
+            double score = 0;
+            for (int t = phaseTerms[p]; t < phaseTerms[p + 1]; ++t)
+                score += factor[terms[t].approach] * static_cast<double>(terms[t].vehicles * now - terms[t].arrivals);
+            score = layout.phase(p).movements & queued ? score : -2;
+            best = score > maxScore ? p : best;
+            maxScore = std::max(score, maxScore);
+        }
+        return best;
+    }
+
+    template <typename Junction>
+    int greenTime(const Junction& j, int phase) const { return j.getSignal().calculateAdaptiveGreenTime(j.criticalLane(phase)); }
+};
+
+// Pre-timed plan: every paired phase in turn for the base green, whatever the demand
+struct FixedTimePolicy {
+    static constexpr const char* name = "fixed";
+    static constexpr bool holdsGreen = true;
+    int next = 0;
+
+    template <typename Junction>
+    int selectPhase(const Junction& j, MovementMask) {
+        const auto& layout = j.getLayout();
+        int phase = next % (layout.phaseCount() - layout.approaches());    // approach phases come last
+        next = phase + 1;
+        return phase;
+    }
+
+    template <typename Junction>
+    int greenTime(const Junction& j, int) const { return j.getSignal().getBaseGreenTime(); }
+};
+
+// Fully actuated: rotate through the paired phases, skipping any without a waiting
+// vehicle, and give each the green its critical lane's queue needs to clear, within
+// the minimum and maximum
+struct ActuatedPolicy {
+    static constexpr const char* name = "actuated";
+    static constexpr bool holdsGreen = false;
+    int next = 0;
+
+    template <typename Junction>
+    int selectPhase(const Junction& j, MovementMask) {
+        const auto& layout = j.getLayout();
+        int paired = layout.phaseCount() - layout.approaches();
+        for (int k = 0; k < paired; ++k) {
+            int phase = (next + k) % paired;
+            if (j.getQueuedVehicles(phase)) {
+                next = phase + 1;
+                return phase;
+            }
+        }
+        return next % paired;
+    }
+
+    template <typename Junction>
+    int greenTime(const Junction& j, int phase) const {
+        const TrafficSignal& signal = j.getSignal();
+        int clearing = j.getDischargeModel().greenFor(j.criticalLane(phase).getQueueLength(), signal.getYellowTime());
+        return std::clamp(clearing, signal.getMinGreenTime(), signal.getMaxGreenTime());
+    }
+};
+
+// Max-pressure: the phase with the largest sum, over its movements, of the lane's
+// queue minus the average lane queue where it leads. It only needs the neighbours'
+// counts and keeps a network stable up to its capacity, unlike purely local scores.
+struct MaxPressurePolicy {
+    static constexpr const char* name = "max-pressure";
+    static constexpr bool holdsGreen = false;
+
+    template <typename Junction>
+    int selectPhase(const Junction& j, MovementMask) {
+        const auto& layout = j.getLayout();
+        std::array<double, maxMovements> pressure;
+        for (int m = 0; m < layout.movements(); ++m)
+            pressure[m] = j.getMovementLane(m).getQueueLength() - j.getDownstreamQueue(layout.exitOf(m)) / double(layout.turns());
+
+        double maxPressure = 0;
+        int best = -1;
+        for (int p = 0; p < layout.phaseCount(); ++p) {
+            MovementMask served = layout.phase(p).movements;
+            double total = 0;
+            for (int m = 0; m < layout.movements(); ++m)
+                if (served >> m & 1) total += pressure[m];
+            if (best < 0 || total > maxPressure) {
+                maxPressure = total;
+                best = p;
+            }
+        }
+        return best;
+    }
+
+    template <typename Junction>
+    int greenTime(const Junction& j, int) const { return j.getSignal().getBaseGreenTime(); }
+};
+
+// Coordinated: a pre-timed plan on a cycle shared with the neighbouring junctions. The
+// arterial's through phase goes green `offsetSeconds` into every cycle, then the other
+// paired phases take the rest in turn; each slot ends with the yellow into the next.
+// Every decision re-reads the clock, so late starts never accumulate into drift.
+struct CoordinatedPolicy {
+    static constexpr const char* name = "coordinated";
+    static constexpr bool holdsGreen = true;
+    int cycleSeconds = 90;
+    int offsetSeconds = 0;
+    int arterialApproach = EAST;    // the arterial runs through this approach and the one facing it
+    double arterialShare = 0.5;     // of the cycle, its closing yellow included
+
+    template <typename Layout>
+    int arterialPhase(const Layout& layout) const {
+        for (int p = 0; p < layout.phaseCount() - layout.approaches(); ++p) {
+            const SignalPhase& phase = layout.phase(p);
+            if (phase.turn == 0 && (phase.approach == arterialApproach || phase.pairedApproach == arterialApproach)) return p;
+        }
+        return 0;
+    }
+
+    // Slot k runs the k-th paired phase from the arterial's on, over [start, start + length)
+    template <typename Layout>
+    int slotPhase(const Layout& layout, int k) const {
+        int paired = layout.phaseCount() - layout.approaches();
+        return (arterialPhase(layout) + k) % paired;
+    }
+    template <typename Layout>
+    void slotBounds(const Layout& layout, int k, double& start, double& length) const {
+        int slots = layout.phaseCount() - layout.approaches();
+        double arterial = std::round(arterialShare * cycleSeconds);
+        double other = slots > 1 ? (cycleSeconds - arterial) / (slots - 1) : 0;
+        start = k == 0 ? 0 : arterial + (k - 1) * other;
+        length = k == 0 ? arterial : other;
+    }
+    template <typename Layout>
+    int slotAt(const Layout& layout, double position) const {
+        int slots = layout.phaseCount() - layout.approaches();
+        position = std::fmod(position, cycleSeconds);
+        for (int k = slots - 1; k > 0; --k) {
+            double start, length;
+            slotBounds(layout, k, start, length);
+            if (position >= start) return k;
+        }
+        return 0;
+    }
+
+    template <typename Junction>
+    double cyclePosition(const Junction& j) const {
+        double t = std::chrono::duration<double>(j.now().time_since_epoch()).count() - offsetSeconds;
+        double position = std::fmod(t, cycleSeconds);
+        return position < 0 ? position + cycleSeconds : position;
+    }
+
+    // Stay on the current phase while its green window lasts; otherwise take the phase
+    // whose window opens once the yellow has run. Half a second absorbs the cycle pause.
+    template <typename Junction>
+    int selectPhase(const Junction& j, MovementMask) const {
+        const auto& layout = j.getLayout();
+        double position = cyclePosition(j), start, length;
+        int yellow = j.getSignal().getYellowTime();
+        int k = slotAt(layout, position + 0.5);
+        slotBounds(layout, k, start, length);
+        double windowPosition = std::fmod(position + 0.5, cycleSeconds);
+        if (slotPhase(layout, k) == j.getSignal().getCurrentPhase() && windowPosition < start + length - yellow) return slotPhase(layout, k);
+        return slotPhase(layout, slotAt(layout, position + yellow));
+    }
+
+    // Whatever is left of the phase's window, so the next yellow lands on its boundary;
+    // an emergency's approach phase has no window and gets the base green
+    template <typename Junction>
+    int greenTime(const Junction& j, int phase) const {
+        const auto& layout = j.getLayout();
+        for (int k = 0; k < layout.phaseCount() - layout.approaches(); ++k) {
+            if (slotPhase(layout, k) != phase) continue;
+            double start, length;
+            slotBounds(layout, k, start, length);
+            double remaining = std::remainder(start + length - j.getSignal().getYellowTime() - cyclePosition(j), cycleSeconds);
+            return std::max(1, static_cast<int>(std::lround(remaining)));
+        }
+        return j.getSignal().getBaseGreenTime();
+    }
+};
+
+using SignalPolicy = std::variant<AdaptivePolicy, FixedTimePolicy, ActuatedPolicy, MaxPressurePolicy, CoordinatedPolicy>;
+
+inline const char* policyName(const SignalPolicy& policy) {
+    return std::visit([](const auto& p) { return p.name; }, policy);
+}
+
+// Default-constructed alternative `index`, for restoring a checkpointed policy
+template <std::size_t I = 0>
+SignalPolicy policyAlternative(std::size_t index) {
+    if constexpr (I + 1 < std::variant_size<SignalPolicy>::value) {
+        if (index != I) return policyAlternative<I + 1>(index);
+    } else if (index != I) {
+        throw std::runtime_error("Unknown signal policy in checkpoint");
+    }
+    return std::variant_alternative_t<I, SignalPolicy>{};
+}
+
+SignalPolicy parsePolicy(const std::string& name);
+
+// Intersection Controller, templated on its approach count. Fixed sizes keep every
+// per-lane table in a std::array sized at compile time; dynamicApproaches takes the
+// layout at construction for unusual junctions.
+template <int Approaches>
+class BasicIntersectionController {
+public:
+    using Layout = JunctionLayout<Approaches>;
+
+private:
+    template <typename T> using ApproachArray = typename Layout::template ApproachArray<T>;
+    template <typename T> using MovementArray = typename Layout::template MovementArray<T>;
+
+    template <typename T, std::size_t N>
+    static void fitStorage(std::array<T, N>&, int) {}
+    template <typename T>
+    static void fitStorage(std::vector<T>& v, int n) { v.resize(n); }
+
+    Layout layout;
+    SimulationClock& clock;
+    MovementArray<TrafficLane> lanes;                   // by layout.movementIndex()
+    ApproachArray<PedestrianSignal> pedestrianSignals;
+    TrafficSignal signal;
+    SeqLock<SignalSnapshot> publishedSignal;    // republished on every light or crossing change
+    std::uint64_t seed;
+    ApproachArray<RandomStream> laneStreams;           // densities, arrivals, turns and emergencies per approach
+    ApproachArray<RandomStream> pedestrianStreams;     // crossing requests per approach
+    RandomArrivalSource randomArrivals;
+    ArrivalSource* arrivalSource;                       // randomArrivals unless a recorded source is set
+    ApproachArray<Arrival> pendingArrivals;             // cycle mode lookahead into arrivalSource
+    ApproachArray<char> hasPendingArrival;
+    int vehicleCounter, cycleCounter;
+    long long totalVehiclesProcessed;
+    SimulationClock::duration totalWaitTime;
+    SignalPolicy policy;
+    MovementMask dirtyLanes;    // queues or densities changed since the policy last looked
+    int emergenciesQueued;
+    ApproachArray<int> downstreamQueue;    // by exit leg: vehicles queued or in transit beyond it
+
+    // Vehicle records live in an arena, private unless a network shares one. Free
+    // handles come from the arena in batches so its lock is rarely taken.
+    std::unique_ptr<VehicleArena> ownArena;
+    VehicleArena* arena;
+    std::vector<VehicleHandle> spareHandles;
+    static constexpr std::size_t handleBatch = 64;
+
+    // Network mode: ids are spaced so several controllers never hand out the same one
+    int vehicleIdStride;
+    Logger* logger;
+    LogLevel logLevel;
+    DepartureSink* departureSink;
+    TraceWriter* traceWriter;
+    ControllerMetrics* metrics;    // live scrape counters, when attached
+    ApproachArray<char> externalDemand;
+
+    // Event-driven mode: phase currently being set up and its discharge budget.
+    // Each green movement runs its own headway chain; the green ends with the last one,
+    // or on time when a chain runs out of green with vehicles left to enter on yellow.
+    DischargeModel discharge;
+    int pendingPhase;
+    int greenTimeRemaining, greenVehiclesAllowed, greenVehiclesPassed, activeDischarges;
+    MovementArray<int> greenSlotsUsed;
+    SimulationClock::time_point greenEnd;
+    std::uint32_t greenSerial;         // tags each green's DEPARTURE chains
+    MovementMask clearingMovements;    // chains past the green, still discharging on yellow
+    bool greenRanOut;
+    bool idle;    // rest in the current green until the next arrival instead of cycling empty lanes
+    bool syntheticPedestrians;
+
+    // Pedestrian intervals overlap the green they walk with. A request still waiting at the
+    // next cycle start gets a phase that walks with it, whatever the policy prefers, the
+    // longest-waiting first. Queued emergencies go ahead only until a request has seen
+    // 1 + emergencyDeferralCycles cycle starts, so a lone request is served by then, and
+    // any request within emergencyDeferralCycles + approaches even with every approach waiting.
+    static constexpr int emergencyDeferralCycles = 2;
+    PedestrianTiming pedestrianTiming;
+    ApproachArray<std::uint8_t> crossingWaitCycles;    // cycle starts seen by each pending request
+    SimulationClock::time_point crossingEnd;           // the running interval's end, in event mode
+
+    // Emergency preemption: an emergency vehicle the current phase does not serve cuts
+    // its green short; the latency runs from its arrival to the start of its own green.
+    // One arriving on green gets it within one headway or the pedestrian clearance,
+    // whichever is longer, then the cycle pause and the yellow: a crossing still in WALK
+    // goes straight to its flashing clearance, which is never cut
+    bool emergencyPreemption, preempting;
+    SimulationClock::time_point preemptRequested;
+    long long preemptionCount;
+    SimulationClock::duration maxPreemptionLatency;
+    // Out of 20 arrivals, 14 go straight on where there is a through movement
+    static constexpr std::uint32_t throughSharePer20 = 14;
+
+    bool holdsGreen() const { return std::visit([](const auto& p) { return p.holdsGreen; }, policy); }
+
+    bool serves(int phase, int movement) const { return layout.phase(phase).movements >> movement & 1; }
+
+    TrafficLane& lane(int approach, int turn) { return lanes[layout.movementIndex(approach, turn)]; }
+
+    // Follow the demand the arrival source implies, or otherwise change at random now and then
+    void updateDensity(int approach) {
+        int density = arrivalSource->densityAt(approach, clock.now());
+        if (density < 0) {
+            RandomStream& stream = laneStreams[approach];
+            if (!stream.oneIn(21)) return;
+            density = stream.below(11);
+        } else if (density == approachDensity(approach)) {
+            return;
+        }
+        for (int t = 0; t < layout.turns(); ++t) {
+            lane(approach, t).setTrafficDensity(density);
+            dirtyLanes |= layout.movementBit(approach, t);
+        }
+    }
+    int approachDensity(int approach) const { return lanes[layout.movementIndex(approach, 0)].getTrafficDensity(); }
+
+    void generatePedestrianRequests() {
+        if (!syntheticPedestrians) return;
+        bool requested = false;
+        for (int a = 0; a < layout.approaches(); ++a) {
+            if (!pedestrianStreams[a].oneIn(16)) continue;
+            pedestrianSignals[a].requestCrossing();
+            requested = true;
+        }
+        if (requested) publishSignal();
+    }
+
+    void publishSignal() {
+        SignalSnapshot snapshot;
+        snapshot.green = signal.getGreenMovements();
+        snapshot.yellow = signal.getYellowMovements();
+        snapshot.time = clock.now().time_since_epoch().count();
+        snapshot.cycle = static_cast<std::uint32_t>(cycleCounter);
+        snapshot.phase = static_cast<std::int8_t>(signal.getCurrentPhase());
+        for (int a = 0; a < layout.approaches(); ++a) {
+            PedestrianState crossing = pedestrianSignals[a].getState();
+            if (crossing == WALK) snapshot.pedestrianWalk |= 1 << a;
+            if (crossing == FLASHING_DONT_WALK) snapshot.pedestrianClearance |= 1 << a;
+            if (pedestrianSignals[a].isRequested()) snapshot.pedestrianRequest |= 1 << a;
+        }
+        publishedSignal.store(snapshot);
+    }
+
+    bool rollEmergency(int approach) { return laneStreams[approach].oneIn(21); }
+
+    // Even junctions send most traffic straight on and split the rest evenly between
+    // the turns; odd ones have no through movement and split evenly throughout
+    int chooseTurn(int approach) {
+        int turns = layout.turns();
+        if (layout.approaches() % 2) return static_cast<int>(laneStreams[approach].below(turns));
+        std::uint32_t roll = laneStreams[approach].below(20);
+        if (roll >= 20 - throughSharePer20) return 0;
+        return 1 + static_cast<int>(roll * (turns - 1) / (20 - throughSharePer20));
+    }
+    int validTurn(int approach, int turn) { return turn >= 0 && turn < layout.turns() ? turn : chooseTurn(approach); }
+
+    // Pedestrians cross in parallel with the straightest movement beside them
+    bool walksWith(int phase, int approach) const { return serves(phase, layout.movementIndex(approach, 0)); }
+
+    bool logs(LogLevel level) const { return logLevel >= level; }
+    void log(LogRecord r) const {
+        r.approaches = layout.approaches();
+        logger->write(r);
+    }
+    void logApproach(LogMessage message, int approach, int value = 0) const { log(LogRecord{ message, approach, false, value, 0, 0 }); }
+    void logPhase(LogMessage message, int phase, int value = 0) const {
+        const SignalPhase& p = layout.phase(phase);
+        log(LogRecord{ message, p.approach, false, value, p.pairedApproach, 0, p.turn });
+    }
+
+    void trace(TraceEventType type, int approach, int turn, int vehicleId, SimulationClock::time_point arrival, int value) {
+        traceWriter->write(TraceRecord{ clock.now().time_since_epoch().count(), arrival.time_since_epoch().count(),
+                                        static_cast<std::uint32_t>(cycleCounter), vehicleId, type, static_cast<std::uint8_t>(approach),
+                                        static_cast<std::uint8_t>(value), static_cast<std::uint8_t>(turn), {} });
+    }
+
+    VehicleHandle createVehicle(bool emergency, SimulationClock::time_point entry) {
+        if (spareHandles.empty()) arena->acquire(spareHandles, handleBatch);
+        VehicleHandle handle = spareHandles.back();
+        spareHandles.pop_back();
+        arena->create(handle, Vehicle(nextVehicleId(), entry, emergency));
+        return handle;
+    }
+
+    void admitVehicle(int approach, int turn, bool emergency, SimulationClock::time_point arrival) {
+        admitVehicle(approach, turn, createVehicle(emergency, arrival), arrival);
+    }
+
+    void admitVehicle(int approach, int turn, VehicleHandle handle, SimulationClock::time_point arrival) {
+        const Vehicle& v = (*arena)[handle];
+        lane(approach, turn).addVehicle(handle, arrival, v.isEmergencyVehicle());
+        dirtyLanes |= layout.movementBit(approach, turn);
+        emergenciesQueued += v.isEmergencyVehicle();
+        if (traceWriter) trace(TRACE_ARRIVAL, approach, turn, v.getId(), arrival, v.isEmergencyVehicle());
+        if (metrics) metrics->setQueue(approach, getApproachQueue(approach));
+        if (v.isEmergencyVehicle() && emergencyPreemption && !preempting && !serves(pendingPhase, layout.movementIndex(approach, turn))) {
+            preempting = true;
+            preemptRequested = clock.now();
+        }
+    }
+
+    // Returns false when the next phase keeps every current movement green, so no yellow is needed
+    bool showYellow(int nextPhase) {
+        ScopedTimer timer(PHASE_SIGNAL_CHANGE);
+        MovementMask ending = signal.setYellow(layout.phase(nextPhase).movements);
+        if (!ending) return false;
+        if (traceWriter) {
+            for (int m = 0; m < layout.movements(); ++m)
+                if (ending >> m & 1) trace(TRACE_LIGHT_CHANGE, layout.approachOf(m), layout.turnOf(m), 0, {}, YELLOW);
+        }
+        if (logs(LOG_CYCLE)) logPhase(MSG_YELLOW, signal.getCurrentPhase());
+        publishSignal();
+        return true;
+    }
+
+    void showGreen(int phase, int greenTime) {
+        ScopedTimer timer(PHASE_SIGNAL_CHANGE);
+        MovementMask lit = signal.getGreenMovements() | signal.getYellowMovements();
+        signal.changePhase(phase, layout.phase(phase).movements);
+        if (traceWriter) {
+            for (int m = 0; m < layout.movements(); ++m) {
+                bool green = signal.isGreen(m);
+                if (green != (lit >> m & 1)) trace(TRACE_LIGHT_CHANGE, layout.approachOf(m), layout.turnOf(m), 0, {}, green ? GREEN : RED);
+            }
+        }
+        if (logs(LOG_CYCLE)) logPhase(MSG_GREEN, phase, greenTime);
+        publishSignal();
+        if (metrics) metrics->recordGreen(phase, clock.now());
+        if (preemptRequested != SimulationClock::time_point::min() && phase >= layout.phaseCount() - layout.approaches()) {
+            ++preemptionCount;
+            maxPreemptionLatency = std::max(maxPreemptionLatency, clock.now() - preemptRequested);
+            if (metrics) metrics->recordPreemption(clock.now() - preemptRequested);
+            preemptRequested = SimulationClock::time_point::min();
+        }
+    }
+
+    bool pedestriansWaiting(int phase) const {
+        for (int a = 0; a < layout.approaches(); ++a)
+            if (pedestrianSignals[a].isRequested() && walksWith(phase, a)) return true;
+        return false;
+    }
+
+    // Start every requested crossing that walks with `phase`; false if there were none
+    bool grantPedestrians(int phase) {
+        bool granted = false;
+        for (int a = 0; a < layout.approaches(); ++a) {
+            if (!pedestrianSignals[a].isRequested() || !walksWith(phase, a)) continue;
+            pedestrianSignals[a].grantCrossing();
+            crossingWaitCycles[a] = 0;
+            granted = true;
+            if (traceWriter) trace(TRACE_PEDESTRIAN_GRANT, a, 0, 0, {}, WALK);
+            if (logs(LOG_CYCLE)) logApproach(MSG_PEDESTRIAN_WALK, a);
+        }
+        if (granted) publishSignal();
+        return granted;
+    }
+
+    void startClearances() {
+        for (int a = 0; a < layout.approaches(); ++a) {
+            if (pedestrianSignals[a].getState() != WALK) continue;
+            pedestrianSignals[a].startClearance();
+            if (logs(LOG_CYCLE)) logApproach(MSG_PEDESTRIAN_CLEARANCE, a);
+        }
+        publishSignal();
+    }
+
+    bool walking() const {
+        return std::any_of(pedestrianSignals.begin(), pedestrianSignals.begin() + layout.approaches(),
+                           [](const PedestrianSignal& p) { return p.getState() == WALK; });
+    }
+
+    bool crossingsIdle() const {
+        return std::all_of(pedestrianSignals.begin(), pedestrianSignals.begin() + layout.approaches(),
+                           [](const PedestrianSignal& p) { return p.getState() == DONT_WALK; });
+    }
+
+    // An emergency that just preempted ends the WALK early; the clearance still runs in full
+    void cutWalk(EventScheduler& scheduler) {
+        if (!walking()) return;
+        startClearances();
+        crossingEnd = clock.now() + std::chrono::seconds(pedestrianTiming.clearanceSeconds);
+        scheduler.scheduleAt(crossingEnd, PEDESTRIAN_END, NORTH, 0, false, 0, greenSerial);
+    }
+
+    void endCrossings() {
+        for (int a = 0; a < layout.approaches(); ++a) {
+            if (pedestrianSignals[a].getState() != DONT_WALK) pedestrianSignals[a].endCrossing();
+        }
+        publishSignal();
+    }
+
+    // Count a cycle start against every request still waiting; run it before the cycle rolls
+    // its own synthetic requests, so those are not overdue until the next one
+    void ageCrossingRequests() {
+        for (int a = 0; a < layout.approaches(); ++a)
+            crossingWaitCycles[a] = pedestrianSignals[a].isRequested() ? static_cast<std::uint8_t>(std::min(crossingWaitCycles[a] + 1, 255)) : 0;
+    }
+
+    // The phase that walks with the longest-waiting request left over from an earlier
+    // cycle, serving the most vehicles among those that do; -1 when there is none. With
+    // `aheadOfEmergencies` only requests already deferred to the limit count.
+    int overduePedestrianPhase(bool aheadOfEmergencies = false) const {
+        int approach = -1, minWait = aheadOfEmergencies ? 1 + emergencyDeferralCycles : 1;
+        for (int a = 0; a < layout.approaches(); ++a)
+            if (crossingWaitCycles[a] >= minWait && (approach < 0 || crossingWaitCycles[a] > crossingWaitCycles[approach])) approach = a;
+        if (approach < 0) return -1;
+        int best = -1, bestQueued = -1;
+        for (int p = 0; p < layout.phaseCount(); ++p) {
+            if (!walksWith(p, approach)) continue;
+            int queued = getQueuedVehicles(p);
+            if (queued > bestQueued) {
+                best = p;
+                bestQueued = queued;
+            }
+        }
+        return best;
+    }
+
+    int nextVehicleId() { return vehicleCounter += vehicleIdStride; }
+
+    void wake(EventScheduler& scheduler) {
+        if (idle) {
+            idle = false;
+            scheduler.schedule(SimulationClock::duration::zero(), CYCLE_START);
+        }
+    }
+
+    void scheduleNextArrival(EventScheduler& scheduler, int approach) {
+        Arrival next;
+        if (arrivalSource->nextArrival(approach, approachDensity(approach), clock.now(), next))
+            scheduler.scheduleAt(next.time, ARRIVAL, approach, 0, next.emergency, next.turn);
+    }
+
+    static SimulationClock::duration toDuration(double seconds) {
+        return std::chrono::duration_cast<SimulationClock::duration>(std::chrono::duration<double>(seconds));
+    }
+
+    void scheduleDeparture(EventScheduler& scheduler, SimulationClock::time_point t, int movement) {
+        scheduler.scheduleAt(t, DEPARTURE, NORTH, 0, false, movement, greenSerial);
+    }
+
+    // The budget is the closed-form count for what is left of the green once any
+    // crossing has walked; the queues start moving after the start-up lost time
+    void startDischarge(EventScheduler& scheduler, int phase) {
+        greenVehiclesAllowed = discharge.departures(std::chrono::duration<double>(greenEnd - clock.now()).count(), signal.getYellowTime());
+        std::fill(greenSlotsUsed.begin(), greenSlotsUsed.end(), 0);
+        clearingMovements = 0;
+        greenRanOut = false;
+        activeDischarges = 0;
+        for (int m = 0; m < layout.movements(); ++m) {
+            if (!serves(phase, m)) continue;
+            scheduleDeparture(scheduler, clock.now() + toDuration(discharge.startupLostSeconds), m);
+            ++activeDischarges;
+        }
+    }
+
+    void endDischarge(EventScheduler& scheduler) {
+        if (--activeDischarges) return;
+        if (logs(LOG_CYCLE)) {
+            log(LogRecord{ MSG_TOTAL_PASSED, 0, false, greenVehiclesPassed, 0, 0 });
+            displayStats(MSG_STATS);
+        }
+        // An early end still waits for the pedestrian interval; its PEDESTRIAN_END goes on
+        if (!crossingsIdle()) return;
+        scheduleCycle(scheduler);
+    }
+
+    // Pre-timed plans run the green out even once its queues have cleared, as does any
+    // green that ran out before its queues did
+    void scheduleCycle(EventScheduler& scheduler) {
+        bool fullGreen = (holdsGreen() || greenRanOut) && !preempting;
+        SimulationClock::time_point end = fullGreen ? std::max(greenEnd, clock.now()) : clock.now();
+        scheduler.scheduleAt(end + std::chrono::milliseconds(cyclePauseMilliseconds), CYCLE_START);
+    }
+
+    // Returns false, leaving the vehicle queued, when the downstream link is full
+    bool dischargeVehicle(int movement) {
+        TrafficLane& from = lanes[movement];
+        int approach = from.getApproach();
+        VehicleHandle handle = from.frontVehicle();
+        SimulationClock::time_point arrival = from.frontArrivalTime();
+        SimulationClock::duration waited = clock.now() - arrival;
+        Vehicle& v = (*arena)[handle];
+        int id = v.getId();
+        bool emergency = v.isEmergencyVehicle();
+        bool stopped = waited > toDuration(discharge.saturationHeadwaySeconds);    // longer than its own headway
+        v.recordCrossing(waited, stopped);
+        if (!departureSink) retireVehicle(handle);
+        else if (!departureSink->accept(layout.exitOf(movement), handle)) {
+            v.revertCrossing(waited, stopped);
+            return false;
+        }
+        from.processVehicle();
+        dirtyLanes |= MovementMask(1) << movement;
+        emergenciesQueued -= emergency;
+        if (traceWriter) trace(TRACE_DEPARTURE, approach, from.getTurn(), id, arrival, emergency);
+        if (logs(LOG_VEHICLE))
+            log(LogRecord{ MSG_VEHICLE_PASSED, approach, emergency, id, 0, std::chrono::duration<double>(waited).count(), from.getTurn() });
+        if (Instrumentation::enabled()) Instrumentation::recordWait(approach, waited.count());
+        if (metrics) {
+            metrics->recordDeparture(approach, waited.count());
+            metrics->setQueue(approach, getApproachQueue(approach));
+        }
+        totalVehiclesProcessed++;
+        totalWaitTime += waited;
+        return true;
+    }
+
+public:
+    static constexpr int cyclePauseMilliseconds = 500;
+
+    explicit BasicIntersectionController(SimulationClock& simClock, std::uint64_t rngSeed = std::random_device{}(), const Layout& junction = Layout())
+        : layout(junction), clock(simClock), arrivalSource(&randomArrivals),
+          vehicleCounter(0), cycleCounter(0), totalVehiclesProcessed(0), totalWaitTime(0), dirtyLanes(~MovementMask(0)), emergenciesQueued(0),
+          ownArena(std::make_unique<VehicleArena>()), arena(ownArena.get()), vehicleIdStride(1), logger(&Logger::global()), logLevel(LOG_VEHICLE), departureSink(nullptr), traceWriter(nullptr), metrics(nullptr),
+          pendingPhase(0), greenTimeRemaining(0), greenVehiclesAllowed(0), greenVehiclesPassed(0), activeDischarges(0),
+          greenSerial(0), clearingMovements(0), greenRanOut(false), idle(false),
+          syntheticPedestrians(true), crossingEnd(SimulationClock::time_point::min()),
+          emergencyPreemption(false), preempting(false), preemptRequested(SimulationClock::time_point::min()),
+          preemptionCount(0), maxPreemptionLatency(0) {
+        int approaches = layout.approaches(), movements = layout.movements();
+        fitStorage(lanes, movements);
+        fitStorage(greenSlotsUsed, movements);
+        fitStorage(pedestrianSignals, approaches);
+        fitStorage(laneStreams, approaches);
+        fitStorage(pedestrianStreams, approaches);
+        fitStorage(pendingArrivals, approaches);
+        fitStorage(hasPendingArrival, approaches);
+        fitStorage(externalDemand, approaches);
+        fitStorage(downstreamQueue, approaches);
+        fitStorage(crossingWaitCycles, approaches);
+        for (int m = 0; m < movements; ++m) lanes[m] = TrafficLane(layout.approachOf(m), clock, layout.turnOf(m));
+        std::fill(greenSlotsUsed.begin(), greenSlotsUsed.end(), 0);
+        std::fill(hasPendingArrival.begin(), hasPendingArrival.end(), false);
+        std::fill(externalDemand.begin(), externalDemand.end(), true);
+        std::fill(downstreamQueue.begin(), downstreamQueue.end(), 0);
+        std::fill(crossingWaitCycles.begin(), crossingWaitCycles.end(), 0);
+        reseed(rngSeed);
+    }
+
+    // Restart every random stream; the same seed reproduces the same traffic bit for bit
+    void reseed(std::uint64_t rngSeed) {
+        seed = rngSeed;
+        for (int i = 0; i < layout.approaches(); ++i) {
+            laneStreams[i] = RandomStream(seed, approachStreamId(STREAM_LANE, i));
+            pedestrianStreams[i] = RandomStream(seed, approachStreamId(STREAM_PEDESTRIAN, i));
+        }
+        randomArrivals.reseed(seed);
+    }
+    std::uint64_t getSeed() const { return seed; }
+
+    void setLogger(Logger& sink) { logger = &sink; }
+    void setLogLevel(LogLevel level) { logLevel = level; }
+    void setSignalTiming(const SignalTiming& timing) { signal.setTiming(timing); }
+    void setDischargeModel(const DischargeModel& model) {
+        if (!(model.saturationHeadwaySeconds > 0)) throw std::invalid_argument("Saturation headway must be positive");
+        if (model.startupLostSeconds < 0 || model.yellowUsedSeconds < 0) throw std::invalid_argument("Lost time and yellow use cannot be negative");
+        discharge = model;
+    }
+    void setSignalPolicy(const SignalPolicy& timingPolicy) {
+        policy = timingPolicy;
+        dirtyLanes = ~MovementMask(0);
+    }
+    // Only the adaptive policy scores density
+    void setScoreDensityWeight(double weight) {
+        if (auto* adaptive = std::get_if<AdaptivePolicy>(&policy)) adaptive->densityWeight = weight;
+        dirtyLanes = ~MovementMask(0);
+    }
+    // Network mode: refreshed between steps from the downstream junction and link
+    void setDownstreamQueue(int exit, int vehicles) { downstreamQueue[exit] = vehicles; }
+    void setDepartureSink(DepartureSink* sink) { departureSink = sink; }
+    void setTraceWriter(TraceWriter* writer) { traceWriter = writer; }
+    // Sized for this junction, e.g. ControllerMetrics(approaches, phases); null detaches it
+    void setMetrics(ControllerMetrics* live) {
+        metrics = live;
+        if (metrics)
+            for (int a = 0; a < layout.approaches(); ++a) metrics->setQueue(a, getApproachQueue(a));
+    }
+    // Replace the synthetic arrivals, e.g. with recorded detector counts; null restores them
+    void setArrivalSource(ArrivalSource* source) {
+        arrivalSource = source ? source : &randomArrivals;
+        std::fill(hasPendingArrival.begin(), hasPendingArrival.end(), false);
+    }
+    // Whether an approach receives randomly generated arrivals (network interiors are fed by links instead)
+    void setExternalDemand(int approach, bool enabled) { externalDemand[approach] = enabled; }
+    // Whether crossing requests are rolled each cycle; push buttons call requestCrossing() instead
+    void setSyntheticPedestrians(bool enabled) { syntheticPedestrians = enabled; }
+    void setPedestrianTiming(const PedestrianTiming& timing) {
+        if (timing.walkSeconds < 0 || timing.clearanceSeconds < 0) throw std::invalid_argument("Pedestrian intervals cannot be negative");
+        pedestrianTiming = timing;
+    }
+    const PedestrianTiming& getPedestrianTiming() const { return pedestrianTiming; }
+    // Event-driven mode: end a conflicting green at the next headway, and any WALK at once, when an emergency vehicle arrives
+    void setEmergencyPreemption(bool enabled) { emergencyPreemption = enabled; }
+    // Safe from any thread; the request shows in the next published snapshot
+    void requestCrossing(int approach) { pedestrianSignals[approach].requestCrossing(); }
+    // Share a network-wide arena so handles stay valid as vehicles pass between junctions;
+    // set it before any vehicle arrives
+    void setVehicleArena(VehicleArena& shared) {
+        if (getQueuedVehicles()) throw std::runtime_error("Vehicle arena must be set before vehicles arrive");
+        if (!spareHandles.empty()) arena->release(spareHandles, spareHandles.size());
+        arena = &shared;
+        ownArena.reset();
+    }
+    VehicleArena& getVehicleArena() { return *arena; }
+    const Vehicle& getVehicle(VehicleHandle handle) const { return (*arena)[handle]; }
+    // Free a vehicle's record once it leaves the simulation
+    void retireVehicle(VehicleHandle handle) {
+        spareHandles.push_back(arena->retire(handle));
+        if (spareHandles.size() > 2 * handleBatch) arena->release(spareHandles, handleBatch);
+    }
+    void setVehicleIdSequence(int firstId, int stride) {
+        vehicleIdStride = stride;
+        vehicleCounter = firstId - stride;
+    }
+
+    // Everything an event-driven run needs to carry on exactly where it stopped: queued
+    // vehicles with their records, densities, lights, crossings, random streams, counters
+    // and the policy. Logging, tracing and sinks are not state and keep their settings.
+    // Vehicles handed over by a network link are not covered; nor are recorded arrivals.
+    void saveState(CheckpointWriter& out) const {
+        if (arrivalSource != &randomArrivals) throw std::runtime_error("Recorded arrivals cannot be checkpointed");
+        out.write(seed);
+        for (int a = 0; a < layout.approaches(); ++a) {
+            out.write(laneStreams[a]);
+            out.write(pedestrianStreams[a]);
+            PedestrianState crossing = pedestrianSignals[a].getState();
+            out.write(static_cast<std::uint8_t>((crossing == WALK) | pedestrianSignals[a].isRequested() << 1 | (crossing == FLASHING_DONT_WALK) << 2));
+            out.write(crossingWaitCycles[a]);
+            out.write(externalDemand[a]);
+            out.write(downstreamQueue[a]);
+        }
+        randomArrivals.saveState(out);
+        for (int m = 0; m < layout.movements(); ++m) {
+            const TrafficLane& l = lanes[m];
+            out.write(l.getTrafficDensity());
+            out.write(l.getQueueLength());
+            for (int i = 0; i < l.getQueueLength(); ++i) {
+                out.write(l.arrivalTimeAt(i));
+                out.write((*arena)[l.vehicleAt(i)]);
+            }
+            out.write(greenSlotsUsed[m]);
+        }
+        out.write(signal);
+        out.write(publishedSignal.load());
+        out.write(static_cast<std::uint32_t>(policy.index()));
+        std::visit([&](const auto& p) {
+            if constexpr (std::is_same<std::decay_t<decltype(p)>, AdaptivePolicy>::value) out.write(p.densityWeight);    // the rest is a cache
+            else out.write(p);
+        }, policy);
+        out.write(vehicleCounter);
+        out.write(vehicleIdStride);
+        out.write(cycleCounter);
+        out.write(totalVehiclesProcessed);
+        out.write(totalWaitTime);
+        out.write(pendingPhase);
+        out.write(greenTimeRemaining);
+        out.write(greenVehiclesAllowed);
+        out.write(greenVehiclesPassed);
+        out.write(activeDischarges);
+        out.write(greenEnd);
+        out.write(discharge);
+        out.write(greenSerial);
+        out.write(clearingMovements);
+        out.write(greenRanOut);
+        out.write(idle);
+        out.write(syntheticPedestrians);
+        out.write(pedestrianTiming);
+        out.write(crossingEnd);
+        out.write(emergencyPreemption);
+        out.write(preempting);
+        out.write(preemptRequested);
+        out.write(preemptionCount);
+        out.write(maxPreemptionLatency);
+    }
+
+    // Replaces this controller's state with a checkpoint's, for the same junction size;
+    // restore the scheduler from the same checkpoint first so the clock matches. The whole
+    // checkpoint is read and checked before any of it is applied, so a truncated or
+    // corrupt one throws and leaves this controller as it was.
+    void restoreState(CheckpointReader& in) {
+        if (in.approaches() != layout.approaches()) throw std::runtime_error("Checkpoint is for a different junction size");
+        auto corrupt = [](bool bad) {
+            if (bad) throw std::runtime_error("Corrupt checkpoint");
+        };
+
+        std::uint64_t savedSeed = in.read<std::uint64_t>();
+        ApproachArray<RandomStream> savedLaneStreams = laneStreams, savedPedestrianStreams = pedestrianStreams;
+        ApproachArray<std::uint8_t> crossings = crossingWaitCycles, savedWaitCycles = crossingWaitCycles;
+        ApproachArray<char> savedDemand = externalDemand;
+        ApproachArray<int> savedDownstream = downstreamQueue;
+        for (int a = 0; a < layout.approaches(); ++a) {
+            savedLaneStreams[a] = in.read<RandomStream>();
+            savedPedestrianStreams[a] = in.read<RandomStream>();
+            crossings[a] = in.read<std::uint8_t>();
+            savedWaitCycles[a] = in.read<std::uint8_t>();
+            savedDemand[a] = in.read<char>();
+            savedDownstream[a] = in.read<int>();
+        }
+        RandomArrivalSource savedArrivals;
+        savedArrivals.restoreState(in);
+
+        struct Queued {
+            SimulationClock::time_point arrival;
+            Vehicle vehicle;
+        };
+        std::vector<std::vector<Queued>> queues(layout.movements());
+        MovementArray<int> densities = greenSlotsUsed, savedSlots = greenSlotsUsed;
+        std::size_t vehicles = 0;
+        for (int m = 0; m < layout.movements(); ++m) {
+            densities[m] = in.read<int>();
+            int n = in.read<int>();
+            // A count the rest of the checkpoint cannot hold is corrupt, not a huge queue
+            corrupt(n < 0 || static_cast<std::size_t>(n) > in.remaining() / (sizeof(SimulationClock::time_point) + sizeof(Vehicle)));
+            queues[m].reserve(n);
+            for (; n > 0; --n) {
+                SimulationClock::time_point arrival = in.read<SimulationClock::time_point>();
+                queues[m].push_back(Queued{ arrival, in.read<Vehicle>() });
+            }
+            vehicles += queues[m].size();
+            savedSlots[m] = in.read<int>();
+        }
+
+        TrafficSignal savedSignal = in.read<TrafficSignal>();
+        SignalSnapshot savedSnapshot = in.read<SignalSnapshot>();
+        std::uint32_t policyIndex = in.read<std::uint32_t>();
+        corrupt(policyIndex >= std::variant_size<SignalPolicy>::value);
+        SignalPolicy savedPolicy = policyAlternative(policyIndex);
+        std::visit([&](auto& p) {
+            using P = std::decay_t<decltype(p)>;
+            if constexpr (std::is_same<P, AdaptivePolicy>::value) p.densityWeight = in.read<double>();
+            else p = in.read<P>();
+        }, savedPolicy);
+        int savedVehicleCounter = in.read<int>();
+        int savedIdStride = in.read<int>();
+        int savedCycleCounter = in.read<int>();
+        long long savedProcessed = in.read<long long>();
+        SimulationClock::duration savedWait = in.read<SimulationClock::duration>();
+        int savedPendingPhase = in.read<int>();
+        int savedGreenTime = in.read<int>();
+        int savedAllowed = in.read<int>();
+        int savedPassed = in.read<int>();
+        int savedDischarges = in.read<int>();
+        SimulationClock::time_point savedGreenEnd = in.read<SimulationClock::time_point>();
+        DischargeModel savedDischarge = in.read<DischargeModel>();
+        std::uint32_t savedGreenSerial = in.read<std::uint32_t>();
+        MovementMask savedClearing = in.read<MovementMask>();
+        bool savedRanOut = in.read<bool>();
+        bool savedIdle = in.read<bool>();
+        bool savedSynthetic = in.read<bool>();
+        PedestrianTiming savedTiming = in.read<PedestrianTiming>();
+        SimulationClock::time_point savedCrossingEnd = in.read<SimulationClock::time_point>();
+        bool savedPreemption = in.read<bool>();
+        bool savedPreempting = in.read<bool>();
+        SimulationClock::time_point savedPreemptRequested = in.read<SimulationClock::time_point>();
+        long long savedPreemptions = in.read<long long>();
+        SimulationClock::duration savedMaxLatency = in.read<SimulationClock::duration>();
+        // Indices the controller looks up without checking
+        corrupt(savedPendingPhase < 0 || savedPendingPhase >= layout.phaseCount() || savedDischarges < 0 ||
+                savedDischarges > layout.movements() || savedIdStride < 1 || !(savedDischarge.saturationHeadwaySeconds > 0));
+
+        // Everything is read; take the handles first, so the arena running out cannot
+        // leave the old queues half gone
+        if (spareHandles.size() < vehicles) arena->acquire(spareHandles, vehicles - spareHandles.size());
+        for (auto& l : lanes)
+            while (l.hasVehicles()) retireVehicle(l.processVehicle());
+
+        seed = savedSeed;
+        laneStreams = savedLaneStreams;
+        pedestrianStreams = savedPedestrianStreams;
+        crossingWaitCycles = savedWaitCycles;
+        externalDemand = savedDemand;
+        downstreamQueue = savedDownstream;
+        for (int a = 0; a < layout.approaches(); ++a) {
+            pedestrianSignals[a] = PedestrianSignal();
+            if (crossings[a] & 5) pedestrianSignals[a].grantCrossing();
+            if (crossings[a] & 4) pedestrianSignals[a].startClearance();
+            if (crossings[a] & 2) pedestrianSignals[a].requestCrossing();
+        }
+        randomArrivals = savedArrivals;
+        arrivalSource = &randomArrivals;
+        std::fill(hasPendingArrival.begin(), hasPendingArrival.end(), false);
+        emergenciesQueued = 0;
+        for (int m = 0; m < layout.movements(); ++m) {
+            TrafficLane& l = lanes[m];
+            l = TrafficLane(layout.approachOf(m), clock, layout.turnOf(m));
+            l.setTrafficDensity(densities[m]);
+            for (const Queued& q : queues[m]) {
+                VehicleHandle handle = spareHandles.back();
+                spareHandles.pop_back();
+                arena->create(handle, q.vehicle);
+                l.addVehicle(handle, q.arrival, q.vehicle.isEmergencyVehicle());
+                emergenciesQueued += q.vehicle.isEmergencyVehicle();
+            }
+        }
+        greenSlotsUsed = savedSlots;
+        signal = savedSignal;
+        publishedSignal.store(savedSnapshot);
+        policy = savedPolicy;
+        dirtyLanes = ~MovementMask(0);
+        vehicleCounter = savedVehicleCounter;
+        vehicleIdStride = savedIdStride;
+        cycleCounter = savedCycleCounter;
+        totalVehiclesProcessed = savedProcessed;
+        totalWaitTime = savedWait;
+        pendingPhase = savedPendingPhase;
+        greenTimeRemaining = savedGreenTime;
+        greenVehiclesAllowed = savedAllowed;
+        greenVehiclesPassed = savedPassed;
+        activeDischarges = savedDischarges;
+        greenEnd = savedGreenEnd;
+        discharge = savedDischarge;
+        greenSerial = savedGreenSerial;
+        clearingMovements = savedClearing;
+        greenRanOut = savedRanOut;
+        idle = savedIdle;
+        syntheticPedestrians = savedSynthetic;
+        pedestrianTiming = savedTiming;
+        crossingEnd = savedCrossingEnd;
+        emergencyPreemption = savedPreemption;
+        preempting = savedPreempting;
+        preemptRequested = savedPreemptRequested;
+        preemptionCount = savedPreemptions;
+        maxPreemptionLatency = savedMaxLatency;
+        setMetrics(metrics);
+    }
+
+    // Start measuring afresh, e.g. once a warm-up has filled the queues
+    void resetStatistics() {
+        totalVehiclesProcessed = 0;
+        totalWaitTime = SimulationClock::duration::zero();
+        preemptionCount = 0;
+        maxPreemptionLatency = SimulationClock::duration::zero();
+    }
+
+    const Layout& getLayout() const { return layout; }
+    int getCycleCount() const { return cycleCounter; }
+    long long getTotalVehiclesProcessed() const { return totalVehiclesProcessed; }
+    SimulationClock::duration getTotalWaitTime() const { return totalWaitTime; }
+    // Seconds per discharged vehicle
+    double getAverageWaitTime() const {
+        return totalVehiclesProcessed ? std::chrono::duration<double>(totalWaitTime).count() / totalVehiclesProcessed : 0;
+    }
+    const TrafficLane& getLane(int approach, int turn = THROUGH) const { return lanes[layout.movementIndex(approach, turn)]; }
+    const TrafficLane& getMovementLane(int movement) const { return lanes[movement]; }
+    const TrafficSignal& getSignal() const { return signal; }
+    const DischargeModel& getDischargeModel() const { return discharge; }
+    SimulationClock::time_point now() const { return clock.now(); }
+    // Lock-free and safe from any thread while the controller runs, e.g. for a dashboard
+    SignalSnapshot getSignalSnapshot() const { return publishedSignal.load(); }
+    const SignalPolicy& getSignalPolicy() const { return policy; }
+    long long getPreemptionCount() const { return preemptionCount; }
+    SimulationClock::duration getMaxPreemptionLatency() const { return maxPreemptionLatency; }
+    int getDownstreamQueue(int exit) const { return downstreamQueue[exit]; }
+    // Detector input: a vehicle joins the lane now, turning by the usual shares unless told
+    void addVehicle(int approach, bool isEmergency = false) { addVehicle(approach, chooseTurn(approach), isEmergency); }
+    void addVehicle(int approach, int turn, bool isEmergency = false) {
+        admitVehicle(approach, turn, isEmergency, clock.now());
+    }
+
+    int getQueuedVehicles() const {
+        int queued = 0;
+        for (const auto& lane : lanes) queued += lane.getQueueLength();
+        return queued;
+    }
+    // Vehicles waiting on the movements `phase` serves
+    int getQueuedVehicles(int phase) const {
+        int queued = 0;
+        for (int m = 0; m < layout.movements(); ++m)
+            if (serves(phase, m)) queued += lanes[m].getQueueLength();
+        return queued;
+    }
+    int getApproachQueue(int approach) const {
+        int queued = 0;
+        for (int t = 0; t < layout.turns(); ++t) queued += lanes[layout.movementIndex(approach, t)].getQueueLength();
+        return queued;
+    }
+
+    void generateTraffic() {
+        ScopedTimer timer(PHASE_GENERATE_TRAFFIC);
+        for (int a = 0; a < layout.approaches(); ++a) {
+            updateDensity(a);
+            if (!externalDemand[a]) continue;
+            if (arrivalSource != &randomArrivals) {
+                admitRecordedArrivals(a);
+                continue;
+            }
+            int arrivalThreshold = 10 - approachDensity(a);
+            if (static_cast<int>(laneStreams[a].below(11)) >= arrivalThreshold) {
+                bool isEmergency = rollEmergency(a);
+                addVehicle(a, isEmergency);
+            }
+        }
+
+        // Simulate random pedestrian requests
+        generatePedestrianRequests();
+    }
+
+    // Cycle mode with a recorded source: admit everything that has arrived by now
+    void admitRecordedArrivals(int approach) {
+        auto now = clock.now();
+        for (;;) {
+            if (!hasPendingArrival[approach] &&
+                !(hasPendingArrival[approach] = arrivalSource->nextArrival(approach, approachDensity(approach), now, pendingArrivals[approach])))
+                return;
+            const Arrival& a = pendingArrivals[approach];
+            if (a.time > now) return;
+            admitVehicle(approach, validTurn(approach, a.turn), a.emergency, a.time);
+            hasPendingArrival[approach] = false;
+        }
+    }
+
+    void processCycle() {
+        ++cycleCounter;
+        if (metrics) metrics->recordCycle();
+        if (logs(LOG_CYCLE)) log(LogRecord{ MSG_CYCLE_HEADER, 0, false, cycleCounter, 0, 0 });
+        ageCrossingRequests();
+        generateTraffic();
+        if (logs(LOG_CYCLE)) displayQueueStatus();
+
+        int nextPhase = findNextPhase();
+        if (showYellow(nextPhase)) clock.waitFor(std::chrono::seconds(signal.getYellowTime()));
+
+        // Pedestrians walk from the start of the green, which is stretched to hold their
+        // interval. Cycle mode puts no green on the clock, so crossing here costs no time
+        // either, as in event mode, where the interval runs out before the green does
+        bool crossing = pedestriansWaiting(nextPhase);
+        int greenTime = phaseGreenTime(nextPhase);
+        if (crossing) greenTime = std::max(greenTime, pedestrianTiming.intervalSeconds());
+        showGreen(nextPhase, greenTime);
+        if (crossing) grantPedestrians(nextPhase);
+
+        processVehicles(nextPhase, greenTime);
+        if (crossing) {
+            startClearances();
+            endCrossings();
+        }
+        if (logs(LOG_CYCLE)) displayStats(MSG_STATS);
+        clock.waitFor(std::chrono::milliseconds(cyclePauseMilliseconds));
+    }
+
+    // Event-driven operation: seed each approach's arrival process and the first cycle
+    void start(EventScheduler& scheduler) {
+        for (int a = 0; a < layout.approaches(); ++a) {
+            if (externalDemand[a]) scheduleNextArrival(scheduler, a);
+        }
+        scheduler.schedule(SimulationClock::duration::zero(), CYCLE_START);
+    }
+
+    void handleEvent(const Event& e, EventScheduler& scheduler) {
+        bool wasPreempting = preempting;
+        switch (e.type) {
+        case ARRIVAL:
+            admitVehicle(e.approach, validTurn(e.approach, e.index), e.emergency, clock.now());
+            scheduleNextArrival(scheduler, e.approach);
+            wake(scheduler);
+            break;
+
+        case LINK_ARRIVAL:
+            admitVehicle(e.approach, chooseTurn(e.approach), e.vehicle, clock.now());
+            wake(scheduler);
+            break;
+
+        case SENSOR_ARRIVAL:
+            admitVehicle(e.approach, validTurn(e.approach, e.index), e.emergency, clock.now());
+            wake(scheduler);
+            break;
+
+        case PEDESTRIAN_REQUEST:
+            requestCrossing(e.approach);
+            publishSignal();
+            wake(scheduler);
+            break;
+
+        case CYCLE_START:
+            if (std::none_of(lanes.begin(), lanes.end(), [](const TrafficLane& l) { return l.hasVehicles(); }) &&
+                std::none_of(pedestrianSignals.begin(), pedestrianSignals.begin() + layout.approaches(),
+                             [](const PedestrianSignal& p) { return p.isRequested(); })) {
+                idle = true;
+                break;
+            }
+            ++cycleCounter;
+            if (metrics) metrics->recordCycle();
+            preempting = false;    // findNextPhase serves the emergency from here
+            if (logs(LOG_CYCLE)) log(LogRecord{ MSG_CYCLE_HEADER, 0, false, cycleCounter, 0, 0 });
+            ageCrossingRequests();
+            {
+                ScopedTimer timer(PHASE_GENERATE_TRAFFIC);
+                for (int a = 0; a < layout.approaches(); ++a) updateDensity(a);
+                generatePedestrianRequests();
+            }
+            if (logs(LOG_CYCLE)) displayQueueStatus();
+            pendingPhase = findNextPhase();
+            scheduler.schedule(SimulationClock::duration::zero(), YELLOW_START, pendingPhase);
+            break;
+
+        case YELLOW_START:
+            scheduler.schedule(showYellow(e.index) ? std::chrono::seconds(signal.getYellowTime()) : SimulationClock::duration::zero(),
+                GREEN_START, e.index);
+            break;
+
+        case GREEN_START: {
+            bool crossing = !preempting && pedestriansWaiting(e.index);
+            greenTimeRemaining = phaseGreenTime(e.index);
+            if (crossing) greenTimeRemaining = std::max(greenTimeRemaining, pedestrianTiming.intervalSeconds());
+            greenVehiclesAllowed = 0;
+            greenVehiclesPassed = 0;
+            greenEnd = clock.now() + std::chrono::seconds(greenTimeRemaining);
+            ++greenSerial;
+            showGreen(e.index, greenTimeRemaining);
+            if (crossing) {
+                crossingEnd = clock.now() + std::chrono::seconds(pedestrianTiming.intervalSeconds());
+                scheduler.scheduleAt(clock.now(), PEDESTRIAN_START, NORTH, 0, false, e.index, greenSerial);
+            }
+            startDischarge(scheduler, e.index);
+            break;
+        }
+
+        // The pedestrian interval's timers, alongside the vehicle discharge. They carry
+        // their green's serial, and a WALK cut short drops the rest of its timers
+        case PEDESTRIAN_START:
+            // Nobody starts to walk once an emergency has arrived with the green
+            if (e.green != greenSerial || preempting) break;
+            grantPedestrians(e.index);
+            scheduler.scheduleAt(clock.now() + std::chrono::seconds(pedestrianTiming.walkSeconds), PEDESTRIAN_CLEARANCE, NORTH, 0, false,
+                                 e.index, greenSerial);
+            break;
+
+        case PEDESTRIAN_CLEARANCE:
+            if (e.green != greenSerial || !walking()) break;
+            startClearances();
+            scheduler.scheduleAt(crossingEnd, PEDESTRIAN_END, NORTH, 0, false, e.index, greenSerial);
+            break;
+
+        case PEDESTRIAN_END:
+            if (e.green != greenSerial) break;
+            endCrossings();
+            if (activeDischarges == 0) scheduleCycle(scheduler);    // the discharge ended first
+            break;
+
+        case DEPARTURE: {
+            // A chain clearing on yellow stops once the next green has kept its movement
+            if (e.green != greenSerial) break;
+            MovementMask bit = MovementMask(1) << e.index;
+            bool onYellow = clock.now() >= greenEnd;
+            bool open = !preempting && greenSlotsUsed[e.index] < greenVehiclesAllowed;
+            // A held green keeps its headways running, so vehicles that reach an empty
+            // lane on green still cross in stride instead of waiting out the cycle.
+            // A headway blocked by a full downstream link is lost, as with real spillback.
+            if (open && (lanes[e.index].hasVehicles() || (holdsGreen() && !onYellow))) {
+                if (lanes[e.index].hasVehicles()) {
+                    ScopedTimer timer(PHASE_PROCESS_VEHICLES);
+                    if (dischargeVehicle(e.index)) ++greenVehiclesPassed;
+                }
+                ++greenSlotsUsed[e.index];
+                SimulationClock::time_point next = clock.now() + toDuration(discharge.saturationHeadwaySeconds);
+                scheduleDeparture(scheduler, next, e.index);
+                if (!onYellow && next >= greenEnd && greenSlotsUsed[e.index] < greenVehiclesAllowed) {
+                    // The rest of the budget enters on yellow while the next cycle begins
+                    clearingMovements |= bit;
+                    greenRanOut = true;
+                    endDischarge(scheduler);
+                }
+            } else if (clearingMovements & bit) {
+                clearingMovements &= ~bit;
+            } else {
+                endDischarge(scheduler);
+            }
+            break;
+        }
+        }
+        if (preempting && !wasPreempting) cutWalk(scheduler);
+    }
+
+    // Emergency vehicles get their approach's all-movement phase, unless a crossing has been
+    // deferred as long as allowed; then overdue crossings, then the policy
+    int findNextPhase() {
+        ScopedTimer timer(PHASE_SELECT_DIRECTION);
+        if (emergenciesQueued) {
+            int pedestrianPhase = overduePedestrianPhase(true);
+            if (pedestrianPhase >= 0) return pedestrianPhase;
+            for (const auto& lane : lanes) {
+                if (lane.hasEmergencyVehicle()) {
+                    if (logs(LOG_CYCLE)) logApproach(MSG_EMERGENCY, lane.getApproach());
+                    return layout.approachPhase(lane.getApproach());
+                }
+            }
+        }
+        int pedestrianPhase = overduePedestrianPhase();
+        if (pedestrianPhase >= 0) return pedestrianPhase;
+
+        MovementMask dirty = dirtyLanes & (layout.movements() == 64 ? ~MovementMask(0) : (MovementMask(1) << layout.movements()) - 1);
+        dirtyLanes = 0;
+        return std::visit([&](auto& p) { return p.selectPhase(*this, dirty); }, policy);
+    }
+
+    // The lane of `phase` with the longest queue
+    const TrafficLane& criticalLane(int phase) const {
+        const TrafficLane* critical = nullptr;
+        for (int m = 0; m < layout.movements(); ++m) {
+            if (!serves(phase, m)) continue;
+            if (!critical || lanes[m].getQueueLength() > critical->getQueueLength()) critical = &lanes[m];
+        }
+        return *critical;
+    }
+
+    int phaseGreenTime(int phase) const {
+        return std::visit([&](const auto& p) { return p.greenTime(*this, phase); }, policy);
+    }
+
+    void processVehicles(int phase, int greenTime) {
+        ScopedTimer timer(PHASE_PROCESS_VEHICLES);
+        int canPass = discharge.departures(greenTime, signal.getYellowTime()), passed = 0;
+        for (int m = 0; m < layout.movements(); ++m) {
+            if (!serves(phase, m)) continue;
+            for (int n = 0; n < canPass && lanes[m].hasVehicles(); ++n) {
+                if (!dischargeVehicle(m)) break;
+                passed++;
+            }
+        }
+        if (logs(LOG_CYCLE)) log(LogRecord{ MSG_TOTAL_PASSED, 0, false, passed, 0, 0 });
+    }
+
+    void displayQueueStatus() const {
+        log(LogRecord{ MSG_QUEUE_HEADER, 0, false, 0, 0, 0 });
+        for (const auto& lane : lanes) {
+            int a = lane.getApproach();
+            log(LogRecord{ MSG_LANE_STATUS, a, pedestrianSignals[a].isRequested(), lane.getQueueLength(),
+                           lane.getTrafficDensity(), lane.getAverageWaitTime(), lane.getTurn() });
+        }
+    }
+
+    // MSG_FINAL_STATS for the end-of-run summary, MSG_STATS after each cycle
+    void displayStats(LogMessage message = MSG_FINAL_STATS) const {
+        log(LogRecord{ message, 0, false, totalVehiclesProcessed, 0, getAverageWaitTime() });
+    }
+
+    static const char* directionToString(Direction d) { return directionName(d); }
+};
+
+using IntersectionController = BasicIntersectionController<4>;
+using TJunctionController = BasicIntersectionController<3>;
+using DynamicIntersectionController = BasicIntersectionController<dynamicApproaches>;
+
+// Compiled once, in traffic_controller.cpp
+extern template class BasicIntersectionController<3>;
+extern template class BasicIntersectionController<4>;
+extern template class BasicIntersectionController<dynamicApproaches>;
+
+// Bounded single-producer/single-consumer queue; push and pop never block or lock
+template <typename T>
+class SpscQueue {
+private:
+    std::vector<T> buffer;
+    std::size_t mask;
+    alignas(64) std::atomic<std::size_t> head;    // next slot to read, owned by the consumer
+    alignas(64) std::atomic<std::size_t> tail;    // next slot to write, owned by the producer
+
+public:
+    explicit SpscQueue(std::size_t minCapacity) : head(0), tail(0) {
+        std::size_t capacity = 1;
+        while (capacity < minCapacity) capacity *= 2;
+        buffer.resize(capacity);
+        mask = capacity - 1;
+    }
+
+    bool tryPush(const T& item) {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == buffer.size()) return false;
+        buffer[t & mask] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    const T* front() const {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return nullptr;
+        return &buffer[h & mask];
+    }
+
+    void pop() { head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    std::size_t size() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire); }
+};
+
+// Fixed set of worker threads that split index ranges between themselves and the caller.
+// Not a work-stealing pool: there are no per-thread deques. Instead every thread claims
+// the next chunk off one atomic counter as it finishes the last, and a range is cut into
+// about eight chunks per thread, so a thread held up by heavy items (a busy corridor of
+// grid nodes) simply claims fewer chunks while the others take the rest.
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wakeWorkers, workDone;
+    const std::function<void(std::size_t)>* task;
+    std::size_t taskSize, chunkSize;
+    std::atomic<std::size_t> nextIndex;
+    std::size_t busyWorkers;
+    unsigned long long generation;
+    bool stopping;
+
+    void runChunks();
+    void workerLoop();
+
+public:
+    explicit ThreadPool(unsigned threadCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned threadCount() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+    // Calls f(i) for every i in [0, n) and returns once all calls have finished
+    void parallelFor(std::size_t n, const std::function<void(std::size_t)>& f);
+};
+
+// Deployed mode: a dedicated control thread runs the event engine against the wall
+// clock. Each wait is a sleep_until on an absolute deadline, so late wake-ups never
+// accumulate into drift, and detector and push-button threads feed it through their
+// own lock-free SPSC queues without ever blocking on the controller.
+enum SensorEventType { SENSOR_VEHICLE, SENSOR_PEDESTRIAN };
+
+struct SensorEvent {
+    SensorEventType type;
+    int approach;
+    int turn;          // SENSOR_VEHICLE: -1 lets the controller choose
+    bool emergency;
+};
+
+template <typename Controller>
+class RealTimeController {
+private:
+    std::chrono::steady_clock::time_point epoch;
+    VirtualClock clock;    // follows the wall clock; only the control thread moves it
+    EventScheduler scheduler;
+    Controller controller;
+    std::vector<std::unique_ptr<SpscQueue<SensorEvent>>> sensors;
+    SimulationClock::duration pollPeriod;    // bounds how long a sensor event can sit unread
+    std::atomic<bool> running;
+    std::thread controlThread;
+    std::atomic<long long> sensorEvents, maxLatenessNs;
+
+    void drainSensors(SimulationClock::time_point now) {
+        for (auto& sensor : sensors) {
+            while (const SensorEvent* e = sensor->front()) {
+                if (e->type == SENSOR_VEHICLE) scheduler.scheduleAt(now, SENSOR_ARRIVAL, e->approach, 0, e->emergency, e->turn);
+                else scheduler.scheduleAt(now, PEDESTRIAN_REQUEST, e->approach);
+                sensor->pop();
+                sensorEvents.store(sensorEvents.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void run() {
+        controller.start(scheduler);
+        while (running.load(std::memory_order_acquire)) {
+            SimulationClock::time_point deadline = now() + pollPeriod;
+            bool timer = !scheduler.empty() && scheduler.nextEventTime() <= deadline;
+            if (timer) deadline = scheduler.nextEventTime();
+            std::this_thread::sleep_until(epoch + deadline.time_since_epoch());
+
+            SimulationClock::time_point woke = now();
+            if (timer && woke - deadline > SimulationClock::duration(maxLatenessNs.load(std::memory_order_relaxed)))
+                maxLatenessNs.store((woke - deadline).count(), std::memory_order_relaxed);
+            drainSensors(woke);
+            scheduler.runUntil(woke, [&](const Event& e) { controller.handleEvent(e, scheduler); });
+        }
+    }
+
+public:
+    explicit RealTimeController(std::uint64_t seed = std::random_device{}(),
+                                SimulationClock::duration poll = std::chrono::milliseconds(10))
+        : epoch(std::chrono::steady_clock::now()), scheduler(clock), controller(clock, seed), pollPeriod(poll),
+          running(false), sensorEvents(0), maxLatenessNs(0) {
+        // Traffic comes from the sensors, and emergencies may not wait out a green
+        for (int a = 0; a < controller.getLayout().approaches(); ++a) controller.setExternalDemand(a, false);
+        controller.setSyntheticPedestrians(false);
+        controller.setEmergencyPreemption(true);
+    }
+
+    ~RealTimeController() { stop(); }
+
+    RealTimeController(const RealTimeController&) = delete;
+    RealTimeController& operator=(const RealTimeController&) = delete;
+
+    // Configure before start() and read after stop(); the control thread owns it in between
+    Controller& getController() { return controller; }
+
+    // One queue per producer thread; add them all before start()
+    SpscQueue<SensorEvent>& addSensor(std::size_t capacity = 256) {
+        if (running.load()) throw std::runtime_error("Sensors must be added before the controller starts");
+        sensors.push_back(std::make_unique<SpscQueue<SensorEvent>>(capacity));
+        return *sensors.back();
+    }
+
+    void start() {
+        if (running.exchange(true)) return;
+        epoch = std::chrono::steady_clock::now();
+        controlThread = std::thread([this] { run(); });
+    }
+
+    void stop() {
+        running.store(false, std::memory_order_release);
+        if (controlThread.joinable()) controlThread.join();
+    }
+
+    // Safe from any thread
+    SignalSnapshot snapshot() const { return controller.getSignalSnapshot(); }
+    SimulationClock::time_point now() const {
+        return SimulationClock::time_point(std::chrono::duration_cast<SimulationClock::duration>(std::chrono::steady_clock::now() - epoch));
+    }
+    long long getSensorEventCount() const { return sensorEvents.load(std::memory_order_relaxed); }
+    // Worst wake-up past a timer deadline
+    SimulationClock::duration getMaxLateness() const { return SimulationClock::duration(maxLatenessNs.load(std::memory_order_relaxed)); }
+    // A sensor event waits at most one poll period, then the controller's own preemption bound applies
+    SimulationClock::duration getPollPeriod() const { return pollPeriod; }
+};
+
+// Totals over vehicles that left the network
+struct TripTotals {
+    long long vehicles = 0, junctions = 0, stops = 0;
+    SimulationClock::duration travel{}, wait{};
+
+    TripTotals& operator+=(const TripTotals& o) {
+        vehicles += o.vehicles;
+        junctions += o.junctions;
+        stops += o.stops;
+        travel += o.travel;
+        wait += o.wait;
+        return *this;
+    }
+};
+
+// Road network: intersections joined by links that carry departing vehicles downstream
+class RoadNetwork {
+private:
+    struct VehicleTransfer {
+        VehicleHandle vehicle;
+        SimulationClock::time_point arrivalTime;    // when the vehicle reaches the downstream stop line
+    };
+
+    // `storage` vehicles fit between the two stop lines, on the link or queued at the
+    // downstream approach. `room` is what was left of it at the last step boundary; only
+    // the upstream node spends it during a step, so admission never depends on how far
+    // the downstream node's thread has got with popping the same link.
+    struct RoadLink {
+        std::size_t to;
+        Direction entryLane;
+        SimulationClock::duration travelTime;
+        std::size_t storage, room;
+        SpscQueue<VehicleTransfer> transit;
+
+        RoadLink(std::size_t toNode, Direction lane, SimulationClock::duration travel, std::size_t storageVehicles)
+            : to(toNode), entryLane(lane), travelTime(travel), storage(storageVehicles), room(storageVehicles), transit(storageVehicles) {}
+    };
+
+    // Each intersection runs on its own clock; all of them meet at every step boundary
+    struct Node : DepartureSink {
+        VirtualClock clock;
+        EventScheduler scheduler;
+        IntersectionController controller;
+        std::array<RoadLink*, 4> outbound;    // by the side the vehicle leaves by; null exits the network
+        std::vector<RoadLink*> inbound;
+        std::vector<TripTotals> trips;    // vehicles that left the network here, by junctions crossed
+        std::vector<DemandProfile> demand;                 // per approach; empty for random arrivals
+        std::unique_ptr<ProfileArrivalSource> arrivals;
+
+        Node() : scheduler(clock), controller(clock, 0), outbound{} {}    // reseeded when the network starts
+
+        bool accept(int exit, VehicleHandle vehicle) override {
+            RoadLink* link = outbound[exit];
+            if (link) {
+                if (!link->room) return false;
+                --link->room;
+                return link->transit.tryPush(VehicleTransfer{ vehicle, clock.now() + link->travelTime });
+            }
+            const Vehicle& v = controller.getVehicle(vehicle);
+            std::size_t crossed = static_cast<std::size_t>(v.getJunctionsCrossed());
+            if (trips.size() <= crossed) trips.resize(crossed + 1);
+            TripTotals& t = trips[crossed];
+            ++t.vehicles;
+            t.junctions += v.getJunctionsCrossed();
+            t.stops += v.getStops();
+            t.travel += clock.now() - v.getEntryTime();
+            t.wait += v.getTripWait();
+            controller.retireVehicle(vehicle);
+            return true;
+        }
+    };
+
+    std::unique_ptr<VehicleArena> vehicles;    // shared, so a vehicle keeps one record for its whole trip
+    std::vector<std::unique_ptr<Node>> nodes;
+    std::vector<std::unique_ptr<RoadLink>> links;
+    SimulationClock::duration stepLength;
+    SimulationClock::time_point currentTime;
+    std::uint64_t seed;
+    bool started;
+
+    void stepNode(Node& node, SimulationClock::time_point stepEnd);
+
+    // Between steps, so every node sees the same snapshot of its neighbours: the
+    // vehicles queued at the approach each exit feeds, plus those still on the link.
+    // Every vehicle on a link is one or the other here, as arrivals drained at the start
+    // of a step all fire within it; the same count sets the room the next step may fill.
+    void publishDownstreamQueues();
+
+public:
+    explicit RoadNetwork(std::uint64_t networkSeed = 1, SimulationClock::duration step = std::chrono::seconds(1))
+        : vehicles(std::make_unique<VehicleArena>()), stepLength(step), currentTime(), seed(networkSeed), started(false) {}
+
+    std::size_t addIntersection();
+
+    // Vehicles leaving `from` by its `exitLane` side join the `entryLane` approach at `to`;
+    // departures are held back while `storageVehicles` are on the link or queued there
+    void addLink(std::size_t from, Direction exitLane, std::size_t to, Direction entryLane,
+                 SimulationClock::duration travelTime, std::size_t storageVehicles = 64);
+
+    // rows x cols grid; a vehicle leaving by one side enters the neighbour on that side
+    // through its facing approach, so the SOUTH exit feeds the NORTH approach below
+    static RoadNetwork grid(int rows, int cols, std::uint64_t seed = 1, SimulationClock::duration travelTime = std::chrono::seconds(30));
+
+    // An east-west arterial of `junctions` in a row: east exits feed the next junction's
+    // west approach and west exits the previous one's east approach; side streets are
+    // fed from outside at every junction
+    static RoadNetwork corridor(int junctions, std::uint64_t seed = 1, SimulationClock::duration travelTime = std::chrono::seconds(30));
+
+    RoadNetwork(RoadNetwork&&) = default;
+
+    void runUntil(SimulationClock::time_point end, ThreadPool& pool);
+    void setSignalPolicy(const SignalPolicy& policy);
+    void setSignalPolicy(std::size_t intersection, const SignalPolicy& policy) { nodes[intersection]->controller.setSignalPolicy(policy); }
+    void setSignalTiming(std::size_t intersection, const SignalTiming& timing) { nodes[intersection]->controller.setSignalTiming(timing); }
+    // Arrivals from outside the network follow these profiles, one per approach, instead of random traffic
+    void setDemandProfiles(std::size_t intersection, std::vector<DemandProfile> profiles) { nodes[intersection]->demand = std::move(profiles); }
+
+    std::size_t intersectionCount() const { return nodes.size(); }
+    const IntersectionController& intersection(std::size_t i) const { return nodes[i]->controller; }
+
+    // Trips that have left the network after crossing at least `minJunctions`
+    TripTotals completedTrips(int minJunctions = 0) const;
+    void displaySummary() const;
+};
+
+// A network scenario: intersections with their timing plans, policies and demand, and
+// the links between them. Text scenarios are line-based, '#' starting a comment:
+//   seed 7                      network seed
+//   horizon 3600                seconds to simulate
+//   step 1                      seconds between network synchronization points
+//   policy actuated             default policy, and likewise
+//   timing base=20 yellow=3 min=10 max=60
+//   profile peak rush-hour      named demand profile: rush-hour, a CSV file, or
+//   profile night 0:40 21600:200    seconds:vehicles-per-hour steps
+//   demand peak                 default demand for arrivals from outside (random if unset)
+//   grid 100 100 30             rows x cols of intersections with links of that travel time
+//   intersection 12 policy=fixed base=30 demand=peak,peak,night,night
+//   link 0 E 1 W 30 [64]        from, exit side, to, entry side, travel seconds, storage
+// Intersections are numbered in order of creation, and naming one past the end adds it.
+// compile() writes the precompiled form: a 64-byte header and then the four record
+// arrays below as they are held in memory, so loading it maps the file and copies
+// each array in one go instead of parsing anything.
+struct ScenarioHeader {
+    char magic[8];
+    std::uint16_t version;
+    std::uint16_t reserved;
+    std::uint32_t intersections, links, profiles, profileSteps;
+    std::uint32_t reserved2;
+    std::uint64_t seed;
+    std::int64_t horizon, step;    // clock ticks (ns)
+    std::uint8_t reserved3[8];
+};
+static_assert(sizeof(ScenarioHeader) == 64, "scenario header is fixed width");
+
+constexpr char scenarioMagic[8] = { 'T', 'L', 'C', 'S', 'C', 'E', 'N', 'E' };
+
+class Scenario {
+public:
+    struct IntersectionRecord {
+        std::int32_t baseGreen, yellow, minGreen, maxGreen;
+        std::int32_t demand[4];    // profile per approach, or -1 on every approach for random arrivals
+        std::uint8_t policy;       // SignalPolicy alternative, default-constructed
+        std::uint8_t reserved[7];
+    };
+    static_assert(sizeof(IntersectionRecord) == 40, "intersection records are fixed width");
+
+    struct LinkRecord {
+        std::uint32_t from, to;
+        std::int64_t travelTime;    // clock ticks (ns)
+        std::uint32_t storage;
+        std::uint8_t exit, entry;   // Direction
+        std::uint8_t reserved[2];
+    };
+    static_assert(sizeof(LinkRecord) == 24, "link records are fixed width");
+
+    struct ProfileRecord {
+        std::uint32_t firstStep, steps;
+    };
+
+    std::uint64_t seed = 1;
+    SimulationClock::duration horizon = std::chrono::hours(1), step = std::chrono::seconds(1);
+    std::vector<IntersectionRecord> intersections;
+    std::vector<LinkRecord> links;
+    std::vector<ProfileRecord> profiles;
+    std::vector<DemandProfile::Step> profileSteps;
+
+    // Text or precompiled, told apart by the magic
+    static Scenario load(const std::string& path);
+    void compile(const std::string& path) const;
+    std::vector<DemandProfile> demandFor(const IntersectionRecord& intersection) const;
+    RoadNetwork build() const;
+
+private:
+    static Scenario fromBinary(const MappedFile& file, const std::string& path);
+
+    // References between records, checked once so build() can trust them
+    void validate(const std::string& path) const;
+    static Direction parseSide(const std::string& side);
+    static Scenario parse(const std::string& text, const std::string& path);
+};
+
+// Many identical 4-way junctions stepped together for large sweeps. Junctions are
+// grouped into fixed-size blocks and every field inside a block is a row indexed
+// [lane or approach][junction], so each kernel below is a straight, branch-free loop of
+// constant length over disjoint rows that the compiler vectorizes for the target (SSE,
+// AVX2, NEON, ...). It is a fluid model on one-second steps: a lane holds a vehicle
+// count and the vehicle-seconds queued on it rather than vehicles, departures take the
+// average wait with them, and there are no emergencies, pedestrians or links.
+// Junctions never interact, so blocks run their whole horizon on separate threads.
+class IntersectionBatch {
+private:
+    using Layout = CrossroadsLayout;
+    static constexpr int movements = Layout::movements(), approaches = Layout::approaches(), phases = Layout::phaseCount();
+    static constexpr int headwaySeconds = 2;    // DischargeModel's default, without its lost times
+    static constexpr std::size_t blockJunctions = 256;    // a block and its temporaries fit in L2
+    enum Stage { STAGE_GREEN, STAGE_YELLOW };
+
+    // Per-second arrival thresholds in units of 2^-31: an approach sees (density + 1) / 110
+    // arrivals a second, as in the event engine, split 14:3:3 through, left and right
+    static constexpr std::int32_t arrivalPerDensity[3] = { static_cast<std::int32_t>(2147483648.0 / 110 * 14 / 20),
+                                                           static_cast<std::int32_t>(2147483648.0 / 110 * 3 / 20),
+                                                           static_cast<std::int32_t>(2147483648.0 / 110 * 3 / 20) };
+    static constexpr std::uint32_t densityRerollPer65536 = 65536 / 630;    // about once every 21 cycles
+
+    // Junctions past the end of the last block are simulated as padding and never reported
+    struct Block {
+        std::int32_t queue[movements][blockJunctions];
+        float waiting[movements][blockJunctions];    // vehicle-seconds queued
+        float score[movements][blockJunctions];      // cached lane scores
+        std::int32_t density[approaches][blockJunctions];
+        std::int32_t phase[blockJunctions], pendingPhase[blockJunctions], stage[blockJunctions], timer[blockJunctions];
+        std::int32_t greenElapsed[blockJunctions], greenMask[blockJunctions], processed[blockJunctions];
+        double waited[blockJunctions];    // seconds, summed over discharged vehicles
+
+        // Temporaries for one step
+        std::int32_t target[blockJunctions], targetMask[blockJunctions], critical[blockJunctions], criticalDensity[blockJunctions];
+        std::int32_t servedQueue[blockJunctions], totalQueue[blockJunctions], phaseQueue[blockJunctions], headwayTick[blockJunctions];
+        std::int32_t bestScore[blockJunctions];    // orderedBits of the best phase score so far
+        float phaseScore[blockJunctions], discharged[blockJunctions];
+    };
+
+    std::size_t count;
+    std::uint32_t seedKey;
+    long long elapsedSeconds;
+    SignalTiming timing;
+    float densityWeight;
+    std::vector<Block> blocks;
+
+    // Low-bias 32-bit integer hash; plain multiplies and shifts, so it vectorizes
+    static std::uint32_t hash32(std::uint32_t x);
+    static std::uint32_t draw(std::uint32_t stepKey, std::uint32_t junction, int stream);
+
+    // Bitwise select; a plain ?: that rewrites its own operand becomes a conditional store
+    // the vectorizer rejects on targets without masked stores
+    static std::int32_t select(bool c, std::int32_t a, std::int32_t b);
+    // Integers that order like the floats they came from, so the argmax compares stay
+    // integer and never need the non-trapping float compares
+    static std::int32_t orderedBits(float f);
+
+    // One second for one block; `first` is the fleet index of its first junction
+    void stepBlock(Block& s, std::uint32_t first, std::uint32_t stepKey) const;
+    void runBlock(std::size_t block, long long fromSecond, long long seconds);
+
+    const Block& blockOf(std::size_t junction) const { return blocks[junction / blockJunctions]; }
+
+    // Sum a per-junction field over the real junctions only
+    template <typename Field>
+    double sumOver(Field field) const {
+        double total = 0;
+        for (std::size_t j = 0; j < count; ++j) total += field(blockOf(j), j % blockJunctions);
+        return total;
+    }
+
+public:
+    explicit IntersectionBatch(std::size_t intersections, std::uint64_t seed = 1, const SignalTiming& signalTiming = SignalTiming(),
+                               double scoreDensityWeight = 0.1);
+
+    // Advance every junction by whole seconds up to `end`
+    void runUntil(SimulationClock::time_point end, ThreadPool& pool);
+
+    std::size_t size() const { return count; }
+    int getPhase(std::size_t junction) const { return blockOf(junction).phase[junction % blockJunctions]; }
+    int getQueueLength(std::size_t junction, int movement) const { return blockOf(junction).queue[movement][junction % blockJunctions]; }
+    long long getTotalVehiclesProcessed() const;
+    long long getQueuedVehicles() const;
+    // Seconds per discharged vehicle
+    double getAverageWaitTime() const;
+    void displaySummary() const;
+};
+
+// Batch Monte Carlo: independent seeded replicas over a grid of controller parameters
+struct ReplicaParameters {
+    SignalTiming timing;
+    SignalPolicy policy;
+};
+
+struct ParameterGrid {
+    std::vector<int> baseGreenTimes{ 20 }, yellowTimes{ 3 }, minGreenTimes{ 10 }, maxGreenTimes{ 60 };
+    std::vector<double> densityWeights{ 0.1 };
+    std::vector<SignalPolicy> policies{ AdaptivePolicy{} };
+
+    // Cartesian product, skipping plans whose minimum green exceeds the maximum;
+    // density weights only multiply the adaptive policy, the only one that reads them
+    std::vector<ReplicaParameters> expand() const;
+};
+
+struct ReplicaResult {
+    double averageWait;          // seconds per discharged vehicle
+    double throughputPerHour;    // discharged vehicles per simulated hour
+};
+
+// Sample mean with a 95% Student-t confidence half-width
+struct SampleSummary {
+    double mean, halfWidth;
+
+    static SampleSummary of(const std::vector<double>& samples);
+};
+
+struct BatchResult {
+    ReplicaParameters parameters;
+    SampleSummary averageWait, throughput;
+};
+
+class BatchRunner {
+private:
+    ThreadPool& pool;
+    SimulationClock::duration horizon, warmup;
+
+public:
+    // With a warm-up, each parameter set is simulated that long once and every replica
+    // forks from its checkpoint, measuring only the `simulatedTime` that follows
+    BatchRunner(ThreadPool& threadPool, SimulationClock::duration simulatedTime, SimulationClock::duration warmupTime = SimulationClock::duration::zero())
+        : pool(threadPool), horizon(simulatedTime), warmup(warmupTime) {}
+
+    std::vector<unsigned char> warmUp(const ReplicaParameters& params, std::uint64_t seed) const;
+
+    // From an empty junction, or from `warmState` with the replica's own random streams
+    ReplicaResult runReplica(const ReplicaParameters& params, std::uint64_t seed, const std::vector<unsigned char>* warmState = nullptr) const;
+
+    // Replicas of every parameter set for seeds [firstSeed, firstSeed + seedCount);
+    // seeds are shared across sets so comparisons use common random numbers. The
+    // warm-ups run on a seed derived from the first, so no replica replays their draws.
+    std::vector<BatchResult> run(const std::vector<ReplicaParameters>& sets, unsigned firstSeed, unsigned seedCount) const;
+    static void displayResults(const std::vector<BatchResult>& results);
+};
+
+// Green-wave coordination along an arterial: every junction runs CoordinatedPolicy on
+// one shared cycle, and only the offsets differ between them
+struct CorridorPlan {
+    int cycleSeconds = 90;
+    double arterialShare = 0.5;
+    std::vector<int> offsets;    // seconds into the cycle at which each junction's arterial green starts
+
+    // Offsets that move one green band eastbound at the link travel time
+    static CorridorPlan progression(int junctions, int cycleSeconds, int travelSeconds);
+    void apply(RoadNetwork& network) const;
+};
+
+// Averages over corridor trips, those that used at least one link of the arterial
+struct CorridorScore {
+    double travelTime;         // seconds per trip
+    double stopsPerVehicle;
+    double objective;          // travel time plus the stop penalty per stop
+    long long trips;
+};
+
+// Searches offsets by coordinate descent: each pass tries every offset step at each
+// junction in turn against the first junction's fixed reference, keeping the best. All
+// candidates of a step, times the replicas, run as independent simulations in parallel;
+// replicas share seeds across candidates, so comparisons use common random numbers.
+class CorridorOptimizer {
+private:
+    ThreadPool& pool;
+    int junctions;
+    SimulationClock::duration linkTravelTime, horizon;
+    unsigned replicas;
+    std::uint64_t firstSeed;
+
+public:
+    int offsetStep = 5;                  // seconds between candidate offsets
+    double stopPenaltySeconds = 15;      // what one stop costs against travel time
+
+    CorridorOptimizer(ThreadPool& threadPool, int corridorJunctions, SimulationClock::duration travelTime,
+                      SimulationClock::duration simulatedTime, unsigned replicaCount = 4, std::uint64_t seed = 1);
+    TripTotals runReplica(const CorridorPlan& plan, std::uint64_t seed) const;
+    std::vector<CorridorScore> evaluate(const std::vector<CorridorPlan>& plans) const;
+    CorridorScore evaluate(const CorridorPlan& plan) const { return evaluate(std::vector<CorridorPlan>{ plan }).front(); }
+
+    CorridorPlan optimize(CorridorPlan plan, int passes = 3) const;
+};
+
+// A timing plan for one time-of-day period, [start, end) in seconds since midnight
+struct TimingPeriod {
+    long long start, end;
+};
+
+struct TimingScore {
+    double meanDelay, p95Delay;    // seconds per vehicle
+    double objective;
+    long long vehicles;
+};
+
+// CMA-ES search for a signal timing plan, following Hansen's tutorial: (mu/mu_w, lambda)
+// selection, rank-one and rank-mu covariance updates and cumulative step-size control.
+// Candidates live in the unit cube and decode to whole seconds within the bounds, so
+// C's Cholesky factor stands in for its square root. Every candidate of a generation,
+// times the replicas, runs as an independent simulation in parallel; replicas share
+// seeds and demand across candidates, so comparisons use common random numbers.
+// A period is simulated from empty over a warm-up before its start and scored on the
+// delay of every vehicle served in it, those still queued at its end included, so a
+// plan cannot look good by starving an approach. Each delay runs from the vehicle's
+// arrival, even one that arrived during the warm-up.
+class TimingTuner {
+private:
+    static constexpr int dimensions = 4;    // yellow, minimum green, maximum green, base green within them
+    using Point = std::array<double, dimensions>;
+    using Matrix = std::array<Point, dimensions>;
+
+    ThreadPool& pool;
+    SignalPolicy policy;
+    const RecordedDemand* demand;
+    unsigned replicas;
+    std::uint64_t firstSeed;
+    std::map<std::array<int, dimensions>, TimingScore> cache;    // per period being tuned
+
+    static std::array<int, dimensions> key(const SignalTiming& t) { return { t.yellowTime, t.minGreenTime, t.maxGreenTime, t.baseGreenTime }; }
+
+    // Lower-triangular L with L * L^T = c
+    static Matrix cholesky(const Matrix& c);
+
+public:
+    int minYellow = 3, maxYellow = 6;         // seconds; a yellow under 3s is unsafe
+    int minGreenBound = 5, maxGreenBound = 120;
+    double p95Weight = 1;                     // objective is mean delay plus this times the p95
+    SimulationClock::duration warmup = std::chrono::minutes(15);
+
+    TimingTuner(ThreadPool& threadPool, const SignalPolicy& timingPolicy, const RecordedDemand* recorded = nullptr,
+                unsigned replicaCount = 4, std::uint64_t seed = 1)
+        : pool(threadPool), policy(timingPolicy), demand(recorded), replicas(std::max(replicaCount, 1u)), firstSeed(seed) {}
+
+    SignalTiming decode(const Point& x) const;
+    Point encode(const SignalTiming& t) const;
+
+    // Waits, in ns, of the vehicles one replica served during the period
+    HistogramSnapshot runReplica(const SignalTiming& timing, const TimingPeriod& period, std::uint64_t seed) const;
+    std::vector<TimingScore> evaluate(const std::vector<SignalTiming>& plans, const TimingPeriod& period);
+    TimingScore evaluate(const SignalTiming& plan, const TimingPeriod& period) { return evaluate(std::vector<SignalTiming>{ plan }, period).front(); }
+
+    // Best plan found from `initial`; `evaluated` counts the distinct plans simulated
+    SignalTiming tune(const SignalTiming& initial, const TimingPeriod& period, int generations, std::size_t* evaluated = nullptr);
+};
@@ -0,0 +1,240 @@
+// Corridor offset optimization and CMA-ES timing tuning
+
+#include "traffic_controller.h"
+
+CorridorPlan CorridorPlan::progression(int junctions, int cycleSeconds, int travelSeconds) {
+    CorridorPlan plan;
+    plan.cycleSeconds = cycleSeconds;
+    for (int i = 0; i < junctions; ++i) plan.offsets.push_back(i * travelSeconds % cycleSeconds);
+    return plan;
+}
+
+void CorridorPlan::apply(RoadNetwork& network) const {
+    for (std::size_t i = 0; i < offsets.size(); ++i) {
+        CoordinatedPolicy policy;
+        policy.cycleSeconds = cycleSeconds;
+        policy.offsetSeconds = offsets[i];
+        policy.arterialShare = arterialShare;
+        network.setSignalPolicy(i, policy);
+    }
+}
+
+CorridorOptimizer::CorridorOptimizer(ThreadPool& threadPool, int corridorJunctions, SimulationClock::duration travelTime,
+                  SimulationClock::duration simulatedTime, unsigned replicaCount, std::uint64_t seed)
+    : pool(threadPool), junctions(corridorJunctions), linkTravelTime(travelTime), horizon(simulatedTime),
+      replicas(std::max(replicaCount, 1u)), firstSeed(seed) {
+    if (junctions < 2) throw std::invalid_argument("A corridor needs at least two junctions");
+}
+
+TripTotals CorridorOptimizer::runReplica(const CorridorPlan& plan, std::uint64_t seed) const {
+    ThreadPool serial(1);
+    RoadNetwork network = RoadNetwork::corridor(junctions, seed, linkTravelTime);
+    plan.apply(network);
+    network.runUntil(SimulationClock::time_point(horizon), serial);
+    return network.completedTrips(junctions);
+}
+
+std::vector<CorridorScore> CorridorOptimizer::evaluate(const std::vector<CorridorPlan>& plans) const {
+    std::vector<TripTotals> runs(plans.size() * replicas);
+    pool.parallelFor(runs.size(), [&](std::size_t i) { runs[i] = runReplica(plans[i / replicas], firstSeed + i % replicas); });
+
+    std::vector<CorridorScore> scores;
+    for (std::size_t p = 0; p < plans.size(); ++p) {
+        TripTotals total;
+        for (unsigned k = 0; k < replicas; ++k) total += runs[p * replicas + k];
+        CorridorScore score{};
+        score.trips = total.vehicles;
+        if (total.vehicles) {
+            score.travelTime = std::chrono::duration<double>(total.travel).count() / total.vehicles;
+            score.stopsPerVehicle = double(total.stops) / total.vehicles;
+        }
+        score.objective = score.travelTime + stopPenaltySeconds * score.stopsPerVehicle;
+        scores.push_back(score);
+    }
+    return scores;
+}
+
+CorridorPlan CorridorOptimizer::optimize(CorridorPlan plan, int passes) const {
+    plan.offsets.resize(junctions, 0);
+    double best = evaluate(plan).objective;
+    for (int pass = 0; pass < passes; ++pass) {
+        bool improved = false;
+        for (int i = 1; i < junctions; ++i) {
+            std::vector<CorridorPlan> candidates;
+            for (int offset = 0; offset < plan.cycleSeconds; offset += std::max(offsetStep, 1)) {
+                CorridorPlan candidate = plan;
+                candidate.offsets[i] = offset;
+                candidates.push_back(candidate);
+            }
+            std::vector<CorridorScore> scores = evaluate(candidates);
+            for (std::size_t c = 0; c < candidates.size(); ++c) {
+                if (scores[c].objective >= best) continue;
+                best = scores[c].objective;
+                plan = candidates[c];
+                improved = true;
+            }
+        }
+        if (!improved) break;
+    }
+    return plan;
+}
+
+TimingTuner::Matrix TimingTuner::cholesky(const Matrix& c) {
+    Matrix l{};
+    for (int i = 0; i < dimensions; ++i)
+        for (int j = 0; j <= i; ++j) {
+            double sum = c[i][j];
+            for (int k = 0; k < j; ++k) sum -= l[i][k] * l[j][k];
+            l[i][j] = i == j ? std::sqrt(std::max(sum, 1e-20)) : sum / l[j][j];
+        }
+    return l;
+}
+
+SignalTiming TimingTuner::decode(const Point& x) const {
+    auto at = [](double v, int lo, int hi) { return lo + static_cast<int>(std::lround(std::clamp(v, 0.0, 1.0) * (hi - lo))); };
+    SignalTiming t;
+    t.yellowTime = at(x[0], minYellow, maxYellow);
+    t.minGreenTime = at(x[1], minGreenBound, maxGreenBound);
+    t.maxGreenTime = at(x[2], minGreenBound, maxGreenBound);
+    if (t.minGreenTime > t.maxGreenTime) std::swap(t.minGreenTime, t.maxGreenTime);
+    t.baseGreenTime = at(x[3], t.minGreenTime, t.maxGreenTime);
+    return t;
+}
+
+TimingTuner::Point TimingTuner::encode(const SignalTiming& t) const {
+    auto at = [](int v, int lo, int hi) { return hi > lo ? std::clamp(double(v - lo) / (hi - lo), 0.0, 1.0) : 0.5; };
+    return { at(t.yellowTime, minYellow, maxYellow), at(t.minGreenTime, minGreenBound, maxGreenBound),
+             at(t.maxGreenTime, minGreenBound, maxGreenBound), at(t.baseGreenTime, t.minGreenTime, t.maxGreenTime) };
+}
+
+HistogramSnapshot TimingTuner::runReplica(const SignalTiming& timing, const TimingPeriod& period, std::uint64_t seed) const {
+    SimulationClock::time_point start{ std::chrono::seconds(period.start) }, end{ std::chrono::seconds(period.end) };
+    SimulationClock::time_point from = std::max(SimulationClock::time_point(), start - warmup);
+    VirtualClock clock;
+    clock.resetTo(from);
+    EventScheduler scheduler(clock);
+    IntersectionController controller(clock, seed);
+    controller.setLogLevel(LOG_OFF);
+    controller.setSignalTiming(timing);
+    controller.setSignalPolicy(policy);
+    std::unique_ptr<RecordedDemandSource> source;
+    if (demand) {
+        source = std::make_unique<RecordedDemandSource>(*demand, from);
+        controller.setArrivalSource(source.get());
+    }
+    auto handle = [&](const Event& e) { controller.handleEvent(e, scheduler); };
+    controller.start(scheduler);
+    scheduler.runUntil(start, handle);
+    ControllerMetrics measured(controller.getLayout().approaches(), controller.getLayout().phaseCount());
+    controller.setMetrics(&measured);
+    scheduler.runUntil(end, handle);
+    controller.setMetrics(nullptr);
+
+    // Departures record their whole wait, warm-up included, so vehicles still queued
+    // count from their arrival too
+    HistogramSnapshot waits = measured.waitTimes();
+    LatencyHistogram queued;
+    for (int m = 0; m < controller.getLayout().movements(); ++m) {
+        const TrafficLane& lane = controller.getMovementLane(m);
+        for (int i = 0; i < lane.getQueueLength(); ++i) queued.record(static_cast<std::uint64_t>((end - lane.arrivalTimeAt(i)).count()));
+    }
+    queued.addTo(waits);
+    return waits;
+}
+
+std::vector<TimingScore> TimingTuner::evaluate(const std::vector<SignalTiming>& plans, const TimingPeriod& period) {
+    std::vector<SignalTiming> fresh;
+    for (const SignalTiming& t : plans)
+        if (!cache.count(key(t)) && std::none_of(fresh.begin(), fresh.end(), [&](const SignalTiming& f) { return key(f) == key(t); }))
+            fresh.push_back(t);
+    std::vector<HistogramSnapshot> runs(fresh.size() * replicas);
+    pool.parallelFor(runs.size(), [&](std::size_t i) { runs[i] = runReplica(fresh[i / replicas], period, firstSeed + i % replicas); });
+    for (std::size_t p = 0; p < fresh.size(); ++p) {
+        HistogramSnapshot total;
+        for (unsigned k = 0; k < replicas; ++k) total.merge(runs[p * replicas + k]);
+        TimingScore score{ total.mean() / 1e9, total.percentile(95) / 1e9, 0, static_cast<long long>(total.total) };
+        score.objective = score.meanDelay + p95Weight * score.p95Delay;
+        cache[key(fresh[p])] = score;
+    }
+    std::vector<TimingScore> scores;
+    for (const SignalTiming& t : plans) scores.push_back(cache[key(t)]);
+    return scores;
+}
+
+SignalTiming TimingTuner::tune(const SignalTiming& initial, const TimingPeriod& period, int generations, std::size_t* evaluated) {
+    cache.clear();
+    const int n = dimensions, lambda = 4 + static_cast<int>(3 * std::log(n)), mu = lambda / 2;
+    std::vector<double> weights(mu);
+    double weightSum = 0, weightSquares = 0;
+    for (int i = 0; i < mu; ++i) weightSum += weights[i] = std::log(mu + 0.5) - std::log(i + 1.0);
+    for (double& w : weights) {
+        w /= weightSum;
+        weightSquares += w * w;
+    }
+    const double muEff = 1 / weightSquares;
+    const double cSigma = (muEff + 2) / (n + muEff + 5);
+    const double dSigma = 1 + 2 * std::max(0.0, std::sqrt((muEff - 1) / (n + 1)) - 1) + cSigma;
+    const double cC = (4 + muEff / n) / (n + 4 + 2 * muEff / n);
+    const double c1 = 2 / ((n + 1.3) * (n + 1.3) + muEff);
+    const double cMu = std::min(1 - c1, 2 * (muEff - 2 + 1 / muEff) / ((n + 2) * (n + 2) + muEff));
+    const double expectedNorm = std::sqrt(double(n)) * (1 - 1.0 / (4 * n) + 1.0 / (21.0 * n * n));
+
+    Point mean = encode(initial), pSigma{}, pC{};
+    Matrix c{}, a{};
+    for (int i = 0; i < n; ++i) c[i][i] = a[i][i] = 1;
+    double sigma = 0.3;
+    RandomStream rng(firstSeed, 0x54554E45);    // "TUNE"
+    auto normal = [&] { return std::sqrt(-2 * std::log1p(-rng.uniform())) * std::cos(2 * 3.14159265358979323846 * rng.uniform()); };
+
+    SignalTiming best = initial;
+    double bestObjective = evaluate(initial, period).objective;
+    for (int g = 0; g < generations; ++g) {
+        std::vector<Point> z(lambda), y(lambda);
+        std::vector<SignalTiming> plans(lambda);
+        for (int k = 0; k < lambda; ++k) {
+            for (int i = 0; i < n; ++i) z[k][i] = normal();
+            Point x;
+            for (int i = 0; i < n; ++i) {
+                y[k][i] = 0;
+                for (int j = 0; j <= i; ++j) y[k][i] += a[i][j] * z[k][j];
+                x[i] = mean[i] + sigma * y[k][i];
+            }
+            plans[k] = decode(x);
+        }
+        std::vector<TimingScore> scores = evaluate(plans, period);
+        std::vector<int> order(lambda);
+        for (int k = 0; k < lambda; ++k) order[k] = k;
+        std::stable_sort(order.begin(), order.end(), [&](int l, int r) { return scores[l].objective < scores[r].objective; });
+        if (scores[order[0]].objective < bestObjective) {
+            bestObjective = scores[order[0]].objective;
+            best = plans[order[0]];
+        }
+
+        Point yw{}, zw{};
+        for (int i = 0; i < mu; ++i)
+            for (int d = 0; d < n; ++d) {
+                yw[d] += weights[i] * y[order[i]][d];
+                zw[d] += weights[i] * z[order[i]][d];
+            }
+        double pSigmaNorm = 0;
+        for (int d = 0; d < n; ++d) {
+            mean[d] += sigma * yw[d];
+            pSigma[d] = (1 - cSigma) * pSigma[d] + std::sqrt(cSigma * (2 - cSigma) * muEff) * zw[d];
+            pSigmaNorm += pSigma[d] * pSigma[d];
+        }
+        pSigmaNorm = std::sqrt(pSigmaNorm);
+        bool stalled = pSigmaNorm / std::sqrt(1 - std::pow(1 - cSigma, 2 * (g + 1))) >= (1.4 + 2.0 / (n + 1)) * expectedNorm;
+        double hSigma = stalled ? 0 : 1;
+        for (int d = 0; d < n; ++d) pC[d] = (1 - cC) * pC[d] + hSigma * std::sqrt(cC * (2 - cC) * muEff) * yw[d];
+        for (int i = 0; i < n; ++i)
+            for (int j = 0; j < n; ++j) {
+                double rankMu = 0;
+                for (int k = 0; k < mu; ++k) rankMu += weights[k] * y[order[k]][i] * y[order[k]][j];
+                c[i][j] = (1 - c1 - cMu) * c[i][j] + c1 * (pC[i] * pC[j] + (1 - hSigma) * cC * (2 - cC) * c[i][j]) + cMu * rankMu;
+            }
+        sigma *= std::exp(cSigma / dSigma * (pSigmaNorm / expectedNorm - 1));
+        a = cholesky(c);
+    }
+    if (evaluated) *evaluated = cache.size();
+    return best;
+}
@@ -0,0 +1,203 @@
+// Google Benchmark suite for the controller hot paths.
+//
+// Build with CMake (the controller_benchmarks target), or by hand from the repository root:
+//   g++ -std=c++17 -O2 -pthread benchmarks/controller_benchmarks.cpp
+//       "PROJECT FEE325262024 2"/{traffic_controller,logger,metrics,trace,demand,network,scenario,batch,tuning}.cpp
+//       -lbenchmark -o controller_benchmarks
+// then record a baseline:
+//   ./controller_benchmarks --benchmark_out=benchmarks/baselines/<platform>.json --benchmark_out_format=json
+// Compare a new run against a stored baseline with benchmark's tools/compare.py.
+// A change that adds or renames a benchmark re-records the baselines it can, so every
+// stored name still matches the suite.
+
+#include "../PROJECT FEE325262024 2/traffic_controller.h"
+
+#include <benchmark/benchmark.h>
+
+static void fillLane(TrafficLane& lane, VirtualClock& clock, int vehicles) {
+    for (int i = 0; i < vehicles; ++i) {
+        lane.addVehicle(VehicleHandle(i + 1), clock.now(), i % 50 == 49);
+        clock.waitFor(std::chrono::milliseconds(100));
+    }
+}
+
+template <typename Controller>
+static void fillController(Controller& controller, VirtualClock& clock, int vehiclesPerLane) {
+    for (int i = 0; i < vehiclesPerLane; ++i) {
+        for (int a = 0; a < controller.getLayout().approaches(); ++a) controller.addVehicle(a);
+        clock.waitFor(std::chrono::milliseconds(100));
+    }
+}
+
+// Steady state: one arrival and one departure per iteration at a fixed queue length
+static void BM_LaneAddProcess(benchmark::State& state) {
+    VirtualClock clock;
+    TrafficLane lane(NORTH, clock);
+    fillLane(lane, clock, static_cast<int>(state.range(0)));
+    VehicleHandle id = 0;
+    for (auto _ : state) {
+        lane.addVehicle(++id, clock.now());
+        benchmark::DoNotOptimize(lane.processVehicle());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LaneAddProcess)->RangeMultiplier(8)->Range(1, 4096);
+
+static void BM_LaneAverageWaitTime(benchmark::State& state) {
+    VirtualClock clock;
+    TrafficLane lane(NORTH, clock);
+    fillLane(lane, clock, static_cast<int>(state.range(0)));
+    for (auto _ : state) benchmark::DoNotOptimize(lane.getAverageWaitTime());
+}
+BENCHMARK(BM_LaneAverageWaitTime)->RangeMultiplier(8)->Range(1, 4096);
+
+static void BM_LaneHasEmergencyVehicle(benchmark::State& state) {
+    VirtualClock clock;
+    TrafficLane lane(NORTH, clock);
+    fillLane(lane, clock, static_cast<int>(state.range(0)));
+    for (auto _ : state) benchmark::DoNotOptimize(lane.hasEmergencyVehicle());
+}
+BENCHMARK(BM_LaneHasEmergencyVehicle)->RangeMultiplier(8)->Range(1, 4096);
+
+static void BM_CalculateAdaptiveGreenTime(benchmark::State& state) {
+    VirtualClock clock;
+    TrafficLane lane(NORTH, clock);
+    TrafficSignal signal;
+    fillLane(lane, clock, static_cast<int>(state.range(0)));
+    for (auto _ : state) benchmark::DoNotOptimize(signal.calculateAdaptiveGreenTime(lane));
+}
+BENCHMARK(BM_CalculateAdaptiveGreenTime)->RangeMultiplier(8)->Range(1, 4096);
+
+static void BM_FindNextPhase(benchmark::State& state) {
+    VirtualClock clock;
+    IntersectionController controller(clock, 1);
+    controller.setLogLevel(LOG_OFF);
+    fillController(controller, clock, static_cast<int>(state.range(0)));
+    for (auto _ : state) benchmark::DoNotOptimize(controller.findNextPhase());
+}
+BENCHMARK(BM_FindNextPhase)->RangeMultiplier(8)->Range(1, 4096);
+
+// Same 4-way junction with its layout chosen at run time
+static void BM_FindNextPhaseDynamicLayout(benchmark::State& state) {
+    VirtualClock clock;
+    DynamicIntersectionController controller(clock, 1, JunctionLayout<dynamicApproaches>(4));
+    controller.setLogLevel(LOG_OFF);
+    fillController(controller, clock, static_cast<int>(state.range(0)));
+    for (auto _ : state) benchmark::DoNotOptimize(controller.findNextPhase());
+}
+BENCHMARK(BM_FindNextPhaseDynamicLayout)->RangeMultiplier(8)->Range(1, 4096);
+
+// Phase selection under each timing policy; the argument indexes SignalPolicy's alternatives
+static void BM_FindNextPhasePolicy(benchmark::State& state) {
+    static const SignalPolicy policies[] = { AdaptivePolicy{}, FixedTimePolicy{}, ActuatedPolicy{}, MaxPressurePolicy{}, CoordinatedPolicy{} };
+    VirtualClock clock;
+    IntersectionController controller(clock, 1);
+    controller.setLogLevel(LOG_OFF);
+    controller.setSignalPolicy(policies[state.range(0)]);
+    fillController(controller, clock, 64);
+    state.SetLabel(policyName(controller.getSignalPolicy()));
+    for (auto _ : state) benchmark::DoNotOptimize(controller.findNextPhase());
+}
+BENCHMARK(BM_FindNextPhasePolicy)->DenseRange(0, 4);
+
+// A monitoring reader's poll of the published signal state
+static void BM_SignalSnapshotRead(benchmark::State& state) {
+    VirtualClock clock;
+    IntersectionController controller(clock, 1);
+    controller.setLogLevel(LOG_OFF);
+    fillController(controller, clock, 8);
+    controller.processCycle();
+    for (auto _ : state) benchmark::DoNotOptimize(controller.getSignalSnapshot());
+}
+BENCHMARK(BM_SignalSnapshotRead);
+
+// Full cycle on virtual time, so the yellow and pedestrian waits cost nothing
+static void BM_ProcessCycle(benchmark::State& state) {
+    VirtualClock clock;
+    IntersectionController controller(clock, 1);
+    controller.setLogLevel(LOG_OFF);
+    fillController(controller, clock, static_cast<int>(state.range(0)));
+    for (auto _ : state) controller.processCycle();
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ProcessCycle)->RangeMultiplier(8)->Range(1, 4096);
+
+// One simulated hour of the event-driven engine
+static void BM_EventEngineHour(benchmark::State& state) {
+    for (auto _ : state) {
+        VirtualClock clock;
+        EventScheduler scheduler(clock);
+        IntersectionController controller(clock, 1);
+        controller.setLogLevel(LOG_OFF);
+        controller.start(scheduler);
+        scheduler.runUntil(SimulationClock::time_point(std::chrono::hours(1)),
+            [&](const Event& e) { controller.handleEvent(e, scheduler); });
+        benchmark::DoNotOptimize(controller.getTotalVehiclesProcessed());
+    }
+}
+BENCHMARK(BM_EventEngineHour)->Unit(benchmark::kMillisecond);
+
+// Drawing arrivals from the rush-hour profile, refilled in batches
+static void BM_ProfileArrivals(benchmark::State& state) {
+    ProfileArrivalSource source(DemandProfile::rushHour(4), 1);
+    Arrival next;
+    int approach = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(source.nextArrival(approach, 0, SimulationClock::time_point(), next));
+        approach = (approach + 1) & 3;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ProfileArrivals);
+
+// Save and restore a warmed-up junction, the cost of forking one replica
+static void BM_CheckpointRoundTrip(benchmark::State& state) {
+    VirtualClock clock;
+    EventScheduler scheduler(clock);
+    IntersectionController controller(clock, 1);
+    controller.setLogLevel(LOG_OFF);
+    controller.start(scheduler);
+    scheduler.runUntil(SimulationClock::time_point(std::chrono::hours(1)), [&](const Event& e) { controller.handleEvent(e, scheduler); });
+    VirtualClock forkClock;
+    EventScheduler forkScheduler(forkClock);
+    IntersectionController fork(forkClock, 1);
+    for (auto _ : state) {
+        CheckpointWriter out(controller.getLayout().approaches());
+        scheduler.saveState(out);
+        controller.saveState(out);
+        CheckpointReader in(out.bytes());
+        forkScheduler.restoreState(in);
+        fork.restoreState(in);
+        state.counters["bytes"] = double(out.bytes().size());
+    }
+}
+BENCHMARK(BM_CheckpointRoundTrip);
+
+// One simulated minute of an N x N grid; lanes scale as 12 * N * N
+static void BM_NetworkMinute(benchmark::State& state) {
+    int side = static_cast<int>(state.range(0));
+    ThreadPool pool(1);
+    RoadNetwork network = RoadNetwork::grid(side, side, 1);
+    SimulationClock::time_point end;
+    for (auto _ : state) {
+        end += std::chrono::minutes(1);
+        network.runUntil(end, pool);
+    }
+    state.counters["lanes"] = double(CrossroadsLayout::movements()) * side * side;
+}
+BENCHMARK(BM_NetworkMinute)->Arg(4)->Arg(16)->Arg(64)->Unit(benchmark::kMillisecond);
+
+// One simulated minute of N independent junctions in the vectorized batch engine
+static void BM_IntersectionBatchMinute(benchmark::State& state) {
+    ThreadPool pool(1);
+    IntersectionBatch fleet(static_cast<std::size_t>(state.range(0)));
+    SimulationClock::time_point end;
+    for (auto _ : state) {
+        end += std::chrono::minutes(1);
+        fleet.runUntil(end, pool);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0) * 60);
+}
+BENCHMARK(BM_IntersectionBatchMinute)->Arg(1024)->Arg(16384)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,85 @@
+// Vehicle arena: slots are reused under a new generation, and a handle kept past its
+// vehicle's retirement no longer resolves
+
+#include "check.h"
+
+#include <set>
+#include <thread>
+
+static void handlesAreFreshAndLive() {
+    VehicleArena arena;
+    std::vector<VehicleHandle> free;
+    arena.acquire(free, 100);
+    check(free.size() == 100 && std::set<VehicleHandle>(free.begin(), free.end()).size() == 100, "acquire hands out distinct handles");
+    check(arena.size() == 0 && !arena.isLive(free[0]), "acquired handles are not live until created");
+    for (std::size_t i = 0; i < free.size(); ++i) arena.create(free[i], Vehicle(static_cast<int>(i), SimulationClock::time_point()));
+    check(arena.size() == 100, "every created vehicle counts as live");
+    bool same = true;
+    for (std::size_t i = 0; i < free.size(); ++i) same &= arena.isLive(free[i]) && arena[free[i]].getId() == static_cast<int>(i);
+    check(same, "each handle resolves to its own vehicle");
+    check(!arena.isLive(0xFFFFFF), "a slot in a chunk never carved is not live");
+}
+
+static void retiredHandlesAreStale() {
+    VehicleArena arena;
+    std::vector<VehicleHandle> free;
+    arena.acquire(free, 1);
+    VehicleHandle first = free.back();
+    arena.create(first, Vehicle(1, SimulationClock::time_point()));
+    VehicleHandle next = arena.retire(first);
+    check(!arena.isLive(first) && arena.size() == 0, "a retired handle is no longer live");
+    check((next & 0xFFFFFF) == (first & 0xFFFFFF) && next != first, "the next handle reuses the slot under a new generation");
+    arena.create(next, Vehicle(2, SimulationClock::time_point()));
+    check(arena.isLive(next) && !arena.isLive(first) && arena[next].getId() == 2, "the stale handle stays dead once the slot is reused");
+}
+
+// The generation is 8 bits, so it wraps after 256 reuses and still tells them apart in between
+static void generationsWrap() {
+    VehicleArena arena;
+    std::vector<VehicleHandle> free;
+    arena.acquire(free, 1);
+    VehicleHandle h = free.back(), original = h;
+    bool ok = true;
+    for (int i = 0; i < 256; ++i) {
+        arena.create(h, Vehicle(i, SimulationClock::time_point()));
+        VehicleHandle next = arena.retire(h);
+        ok &= !arena.isLive(h) && (i == 255 || next != original);
+        h = next;
+    }
+    check(ok, "every reuse before the wrap gets a new handle");
+    check(h == original, "the 256th reuse wraps back to the first handle");
+}
+
+// Chunks never move, so handles stay valid while other threads carve new ones
+static void sharedAcrossThreads() {
+    VehicleArena arena;
+    std::vector<std::vector<VehicleHandle>> handles(4);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+        threads.emplace_back([&, t] {
+            for (int batch = 0; batch < 20; ++batch) {
+                std::size_t start = handles[t].size();
+                arena.acquire(handles[t], 256);
+                for (std::size_t i = start; i < handles[t].size(); ++i) arena.create(handles[t][i], Vehicle(t, SimulationClock::time_point()));
+            }
+        });
+    for (std::thread& t : threads) t.join();
+    std::set<VehicleHandle> all;
+    bool owned = true;
+    for (int t = 0; t < 4; ++t)
+        for (VehicleHandle h : handles[t]) {
+            all.insert(h);
+            owned &= arena.isLive(h) && arena[h].getId() == t;
+        }
+    check(all.size() == 4 * 20 * 256 && arena.size() == 4 * 20 * 256, "threads never receive the same slot");
+    check(owned, "every vehicle is still the one its thread created");
+}
+
+int main() {
+    return runTests({
+        { "handles are fresh and live", handlesAreFreshAndLive },
+        { "retired handles are stale", retiredHandlesAreStale },
+        { "generations wrap", generationsWrap },
+        { "shared across threads", sharedAcrossThreads },
+    });
+}
@@ -0,0 +1,91 @@
+// Shared by the test programs under tests/: each is a list of cases run by runTests(),
+// which prints one line per case and exits non-zero when any check failed. CTest runs
+// them from the build directory, so files they write land there.
+#pragma once
+
+#include "../PROJECT FEE325262024 2/traffic_controller.h"
+
+inline int failures = 0;
+
+inline void check(bool ok, const std::string& what) {
+    if (ok) return;
+    std::cerr << "  failed: " << what << "\n";
+    ++failures;
+}
+
+// Assert that `f` throws E
+template <typename E, typename F>
+void checkThrows(F&& f, const std::string& what) {
+    try {
+        f();
+    } catch (const E&) {
+        return;
+    }
+    check(false, what + " should throw");
+}
+
+struct TestCase {
+    const char* name;
+    void (*run)();
+};
+
+inline int runTests(std::initializer_list<TestCase> cases) {
+    for (const TestCase& t : cases) {
+        int before = failures;
+        try {
+            t.run();
+        } catch (const std::exception& e) {
+            check(false, std::string("threw ") + e.what());
+        }
+        std::cout << (failures == before ? "ok    " : "FAIL  ") << t.name << "\n";
+    }
+    return failures ? 1 : 0;
+}
+
+// An event-driven junction on its own virtual clock, quiet and started
+template <typename Controller = IntersectionController>
+struct EventRun {
+    VirtualClock clock;
+    EventScheduler scheduler;
+    Controller controller;
+
+    template <typename... Args>
+    explicit EventRun(Args&&... args) : scheduler(clock), controller(clock, std::forward<Args>(args)...) {
+        controller.setLogLevel(LOG_OFF);
+    }
+
+    void start() { controller.start(scheduler); }
+    void runUntil(SimulationClock::time_point end) {
+        scheduler.runUntil(end, [this](const Event& e) { controller.handleEvent(e, scheduler); });
+    }
+    void runFor(std::chrono::seconds s) { runUntil(clock.now() + s); }
+};
+
+// Everything a network run reports, per intersection and over completed trips
+struct NetworkResult {
+    std::vector<long long> crossings, cycles, queued;
+    std::vector<SimulationClock::duration::rep> waits;
+    TripTotals trips;
+
+    explicit NetworkResult(const RoadNetwork& network) : trips(network.completedTrips()) {
+        for (std::size_t i = 0; i < network.intersectionCount(); ++i) {
+            const IntersectionController& c = network.intersection(i);
+            crossings.push_back(c.getTotalVehiclesProcessed());
+            cycles.push_back(c.getCycleCount());
+            queued.push_back(c.getQueuedVehicles());
+            waits.push_back(c.getTotalWaitTime().count());
+        }
+    }
+
+    bool operator==(const NetworkResult& o) const {
+        return crossings == o.crossings && cycles == o.cycles && queued == o.queued && waits == o.waits &&
+            trips.vehicles == o.trips.vehicles && trips.junctions == o.trips.junctions && trips.stops == o.trips.stops &&
+            trips.travel == o.trips.travel && trips.wait == o.trips.wait;
+    }
+};
+
+inline NetworkResult runNetwork(RoadNetwork network, SimulationClock::duration horizon, unsigned threads) {
+    ThreadPool pool(threads);
+    network.runUntil(SimulationClock::time_point(horizon), pool);
+    return NetworkResult(network);
+}
@@ -0,0 +1,181 @@
+// Checkpoints: a resumed run matches one carried straight through, and a truncated or
+// corrupt checkpoint is rejected without touching the controller it was meant for
+
+#include "check.h"
+
+// A junction's observable state. Checkpoint bytes are no use for this: they carry
+// struct padding and vehicle handles, which differ between equal runs.
+struct JunctionState {
+    std::vector<std::int64_t> values;
+
+    JunctionState(const EventScheduler& scheduler, const IntersectionController& c) {
+        SignalSnapshot s = c.getSignalSnapshot();
+        values = { static_cast<std::int64_t>(scheduler.pending()), scheduler.nextEventTime().time_since_epoch().count(),
+                   c.getTotalVehiclesProcessed(), c.getTotalWaitTime().count(), c.getCycleCount(), c.getPreemptionCount(),
+                   static_cast<std::int64_t>(s.green), static_cast<std::int64_t>(s.yellow), s.time, s.cycle, s.phase,
+                   s.pedestrianWalk, s.pedestrianClearance, s.pedestrianRequest };
+        for (int m = 0; m < c.getLayout().movements(); ++m) {
+            const TrafficLane& lane = c.getMovementLane(m);
+            values.push_back(lane.getTrafficDensity());
+            values.push_back(lane.getQueueLength());
+            for (int i = 0; i < lane.getQueueLength(); ++i) {
+                const Vehicle& v = c.getVehicle(lane.vehicleAt(i));
+                values.insert(values.end(), { lane.arrivalTimeAt(i).time_since_epoch().count(), v.getId(), v.isEmergencyVehicle() });
+            }
+        }
+    }
+};
+
+// An hour straight through against half an hour, a checkpoint, and the rest resumed
+// by a fresh controller
+static void resumeMatchesStraightRun() {
+    EventRun<> straight(1), first(1), resumed(2);
+    straight.start();
+    straight.runUntil(SimulationClock::time_point(std::chrono::seconds(3600)));
+    first.start();
+    first.runUntil(SimulationClock::time_point(std::chrono::seconds(1800)));
+    CheckpointWriter out(first.controller.getLayout().approaches());
+    first.scheduler.saveState(out);
+    first.controller.saveState(out);
+
+    CheckpointReader in(out.bytes());
+    resumed.scheduler.restoreState(in);
+    resumed.controller.restoreState(in);
+    resumed.runUntil(SimulationClock::time_point(std::chrono::seconds(3600)));
+
+    const IntersectionController &a = resumed.controller, &b = straight.controller;
+    check(a.getTotalVehiclesProcessed() == b.getTotalVehiclesProcessed(), "vehicles processed after resuming");
+    check(a.getTotalWaitTime() == b.getTotalWaitTime(), "total wait after resuming");
+    check(a.getCycleCount() == b.getCycleCount(), "cycle count after resuming");
+    check(JunctionState(resumed.scheduler, a).values == JunctionState(straight.scheduler, b).values, "state at the horizon after resuming");
+}
+
+// A controller-only checkpoint of a busy junction
+static std::vector<unsigned char> controllerCheckpoint(std::uint64_t seed, std::chrono::seconds at) {
+    EventRun<> run(seed);
+    run.start();
+    run.runFor(at);
+    CheckpointWriter out(run.controller.getLayout().approaches());
+    run.controller.saveState(out);
+    return out.bytes();
+}
+
+// Restoring `bytes` into `run` must throw, leaving its state and its arena as they were
+static bool rejectedUntouched(EventRun<>& run, const std::vector<unsigned char>& bytes) {
+    JunctionState before(run.scheduler, run.controller);
+    std::int64_t live = run.controller.getVehicleArena().size();
+    bool threw = false;
+    try {
+        CheckpointReader in(bytes);
+        run.controller.restoreState(in);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    return threw && JunctionState(run.scheduler, run.controller).values == before.values && run.controller.getVehicleArena().size() == live;
+}
+
+static void truncatedCheckpointsChangeNothing() {
+    EventRun<> victim(3);
+    victim.start();
+    victim.runFor(std::chrono::seconds(1200));
+    check(victim.controller.getQueuedVehicles() > 0, "the junction has vehicles to lose");
+    std::vector<unsigned char> bytes = controllerCheckpoint(4, std::chrono::seconds(2700));
+    bool ok = true;
+    for (std::size_t size = 0; size < bytes.size(); size += size + 64 < bytes.size() ? 7 : 1)
+        ok &= rejectedUntouched(victim, std::vector<unsigned char>(bytes.begin(), bytes.begin() + size));
+    check(ok, "every truncation throws and leaves the controller as it was");
+
+    // The unchanged controller still runs on, and the whole checkpoint still restores
+    victim.runFor(std::chrono::seconds(600));
+    CheckpointReader in(bytes);
+    victim.controller.restoreState(in);
+    check(in.remaining() == 0, "the whole checkpoint is read");
+}
+
+// The offset at which checkpoint i holds the 32-bit value i, for every i: a field found
+// by varying it alone. Comparing several values skips padding bytes that happen to differ.
+static std::size_t fieldOffset(const std::vector<std::vector<unsigned char>>& checkpoints) {
+    std::size_t size = checkpoints[0].size();
+    for (const auto& c : checkpoints) size = std::min(size, c.size());
+    for (std::size_t at = sizeof(CheckpointHeader); at + sizeof(std::uint32_t) <= size; ++at) {
+        bool match = true;
+        for (std::size_t i = 0; i < checkpoints.size(); ++i) {
+            std::uint32_t value;
+            std::memcpy(&value, checkpoints[i].data() + at, sizeof value);
+            match &= value == i;
+        }
+        if (match) return at;
+    }
+    return size;
+}
+
+static std::vector<unsigned char> withInt(std::vector<unsigned char> bytes, std::size_t at, std::int32_t value) {
+    std::memcpy(bytes.data() + at, &value, sizeof value);
+    return bytes;
+}
+
+static void corruptCountsAreRejected() {
+    auto save = [](EventRun<>& run) {
+        CheckpointWriter out(run.controller.getLayout().approaches());
+        run.controller.saveState(out);
+        return out.bytes();
+    };
+    // Queues of 0, 1 and 2 vehicles show where the first lane's count is; each policy, its index
+    std::vector<std::vector<unsigned char>> queues, policies;
+    for (int n = 0; n < 3; ++n) {
+        EventRun<> run(5);
+        for (int i = 0; i < n; ++i) run.scheduler.scheduleAt(run.clock.now(), SENSOR_ARRIVAL, NORTH, 0, false, 0);
+        run.runUntil(run.clock.now());
+        queues.push_back(save(run));
+    }
+    for (std::size_t p = 0; p < std::variant_size<SignalPolicy>::value; ++p) {
+        EventRun<> run(5);
+        run.controller.setSignalPolicy(policyAlternative(p));
+        policies.push_back(save(run));
+    }
+    const std::vector<unsigned char>& base = queues[0];
+    std::size_t count = fieldOffset(queues), policyIndex = fieldOffset(policies);
+    check(count < base.size() && policyIndex < base.size() && count < policyIndex, "the fields are found");
+
+    EventRun<> victim(6);
+    victim.start();
+    victim.runFor(std::chrono::seconds(900));
+    check(rejectedUntouched(victim, withInt(base, count, -1)), "a negative queue length");
+    check(rejectedUntouched(victim, withInt(base, count, 1 << 30)), "a queue longer than the checkpoint");
+    check(rejectedUntouched(victim, withInt(base, policyIndex, 99)), "an unknown policy");
+}
+
+// The scheduler's part checks the same way
+static void truncatedSchedulerChangesNothing() {
+    EventRun<> source(7), victim(8);
+    source.start();
+    source.runFor(std::chrono::seconds(1800));
+    victim.start();
+    victim.runFor(std::chrono::seconds(600));
+    CheckpointWriter out(4);
+    source.scheduler.saveState(out);
+    std::vector<unsigned char> bytes = out.bytes();
+    bool ok = true;
+    for (std::size_t size = sizeof(CheckpointHeader); size < bytes.size(); ++size) {
+        std::size_t pending = victim.scheduler.pending();
+        SimulationClock::time_point now = victim.clock.now(), next = victim.scheduler.nextEventTime();
+        CheckpointReader in(bytes.data(), size);
+        bool threw = false;
+        try {
+            victim.scheduler.restoreState(in);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        ok &= threw && victim.scheduler.pending() == pending && victim.clock.now() == now && victim.scheduler.nextEventTime() == next;
+    }
+    check(ok, "every truncation throws and leaves the queue and clock as they were");
+}
+
+int main() {
+    return runTests({
+        { "resume matches a straight run", resumeMatchesStraightRun },
+        { "truncated checkpoints change nothing", truncatedCheckpointsChangeNothing },
+        { "corrupt counts are rejected", corruptCountsAreRejected },
+        { "truncated scheduler changes nothing", truncatedSchedulerChangesNothing },
+    });
+}
@@ -0,0 +1,61 @@
+// Saturation-flow discharge: greenFor() inverts departures(), and the model reduces to
+// the old green / 2 count without lost time or yellow use
+
+#include "check.h"
+
+static const DischargeModel models[] = {
+    DischargeModel{},
+    DischargeModel{ 3.2, 1.7, 1 },
+    DischargeModel{ 0, 2.5, 4 },
+    DischargeModel{ 1.5, 2, 0 },
+};
+
+static void greenForInvertsDepartures() {
+    bool enough = true, shortest = true;
+    for (const DischargeModel& d : models)
+        for (int yellow : { 0, 3, 5 })
+            for (int n = 0; n <= 200; ++n) {
+                int green = d.greenFor(n, yellow);
+                enough &= d.departures(green, yellow) >= n;
+                // Zero is the floor; a queue the yellow alone clears needs no green
+                shortest &= green == 0 || d.departures(green - 1, yellow) < n;
+            }
+    check(enough, "greenFor(n) lets at least n vehicles through");
+    check(shortest, "one second less lets fewer through");
+}
+
+static void noLostTimeIsHalfTheGreen() {
+    DischargeModel old{ 0, 2, 0 };
+    bool same = true;
+    for (int yellow = 0; yellow <= 5; ++yellow)
+        for (int green = 0; green <= 200; ++green) same &= old.departures(green, yellow) == green / 2;
+    check(same, "lost time 0 and yellow use 0 give green / 2");
+    check(old.departureTime(0) == 0 && old.departureTime(5) == 10, "departures are one headway apart from the green's start");
+}
+
+static void departuresMatchTheModel() {
+    DischargeModel d;
+    check(d.departures(2, 3) == 1 && d.departures(1, 3) == 0, "one vehicle needs a whole headway of effective green");
+    check(d.departures(20, 1) == 9, "only the yellow's length counts once it is shorter than the use");
+    check(d.departures(0, 0) == 0 && d.greenFor(0, 3) == 0, "nothing passes before the lost time, and no queue needs no green");
+}
+
+static void rejectsBadModels() {
+    VirtualClock clock;
+    IntersectionController c(clock, 1);
+    checkThrows<std::invalid_argument>([&] { c.setDischargeModel(DischargeModel{ 2, 0, 2 }); }, "a zero saturation headway");
+    checkThrows<std::invalid_argument>([&] { c.setDischargeModel(DischargeModel{ 2, -1, 2 }); }, "a negative saturation headway");
+    checkThrows<std::invalid_argument>([&] { c.setDischargeModel(DischargeModel{ -1, 2, 2 }); }, "a negative lost time");
+    check(c.getDischargeModel().saturationHeadwaySeconds == 2, "a rejected model leaves the old one");
+    c.setDischargeModel(DischargeModel{ 0, 2, 0 });
+    check(c.getDischargeModel().startupLostSeconds == 0, "a valid model applies");
+}
+
+int main() {
+    return runTests({
+        { "greenFor inverts departures", greenForInvertsDepartures },
+        { "no lost time is half the green", noLostTimeIsHalfTheGreen },
+        { "departures match the model", departuresMatchTheModel },
+        { "rejects bad models", rejectsBadModels },
+    });
+}
@@ -0,0 +1,167 @@
+// Lane queues: the running aggregates against a walk over the queue, and the ring
+// buffer underneath
+
+#include "check.h"
+
+#include <deque>
+
+struct Queued {
+    long long arrival;
+    bool emergency;
+};
+
+// What the running aggregates must equal: totals recomputed from every queued vehicle
+static bool matchesScan(const TrafficLane& lane, const std::deque<Queued>& expected, const VirtualClock& clock) {
+    long long now = clock.now().time_since_epoch().count(), wait = 0, sum = 0;
+    bool emergency = false;
+    for (const Queued& q : expected) {
+        wait += now - q.arrival;
+        sum += q.arrival;
+        emergency |= q.emergency;
+    }
+    return lane.getQueueLength() == static_cast<int>(expected.size()) && lane.getTotalWaitTime().count() == wait &&
+        lane.getArrivalTimeTotal() == sum && lane.hasEmergencyVehicle() == emergency;
+}
+
+static void aggregatesMatchScan() {
+    VirtualClock clock;
+    TrafficLane lane(NORTH, clock);
+    std::deque<Queued> expected;
+    RandomStream rng(3);
+    bool ok = true;
+    VehicleHandle next = 0;
+    for (int step = 0; step < 20000; ++step) {
+        clock.waitFor(std::chrono::milliseconds(rng.below(3000)));
+        if (rng.below(5) < 3 || expected.empty()) {
+            bool emergency = rng.oneIn(15);
+            // Arrivals may be stamped a little before now, as link transfers are
+            long long arrival = clock.now().time_since_epoch().count() - rng.below(1000);
+            lane.addVehicle(next++, SimulationClock::time_point(SimulationClock::duration(arrival)), emergency);
+            expected.push_back({ arrival, emergency });
+        } else {
+            lane.processVehicle();
+            expected.pop_front();
+        }
+        ok &= matchesScan(lane, expected, clock);
+    }
+    check(ok, "wait, arrival sum and emergency flag track every add and pop");
+}
+
+static void averageWaitIsPerVehicle() {
+    VirtualClock clock;
+    TrafficLane lane(EAST, clock);
+    check(lane.getAverageWaitTime() == 0 && lane.getTotalWaitTime() == SimulationClock::duration::zero(), "an empty lane has no wait");
+    lane.addVehicle(0, clock.now());
+    clock.waitFor(std::chrono::seconds(10));
+    lane.addVehicle(1, clock.now());
+    clock.waitFor(std::chrono::seconds(4));
+    check(lane.getTotalWaitTime() == std::chrono::seconds(18), "total wait is the sum of the two waits");
+    check(std::abs(lane.getAverageWaitTime() - 9.0) < 1e-12, "average wait is the total over the queue");
+    lane.processVehicle();
+    check(lane.getTotalWaitTime() == std::chrono::seconds(4), "the departed vehicle's wait leaves the total");
+}
+
+static void emergencyCountFollowsDepartures() {
+    VirtualClock clock;
+    TrafficLane lane(SOUTH, clock);
+    lane.addVehicle(0, clock.now(), true);
+    lane.addVehicle(1, clock.now(), false);
+    lane.addVehicle(2, clock.now(), true);
+    lane.processVehicle();
+    check(lane.hasEmergencyVehicle(), "one emergency vehicle is still queued");
+    lane.processVehicle();
+    lane.processVehicle();
+    check(!lane.hasEmergencyVehicle(), "no emergency vehicle once both left");
+    checkThrows<std::runtime_error>([&] { lane.processVehicle(); }, "processing an empty lane");
+}
+
+// Totals keep nanosecond resolution, and stay exact long after n * now would overflow
+static void waitIsExactLateInARun() {
+    VirtualClock clock;
+    const SimulationClock::duration late = std::chrono::hours(24 * 365 * 3);
+    clock.advanceTo(SimulationClock::time_point(late));
+    TrafficLane lane(WEST, clock);
+    const int vehicles = 5000;    // 5000 * 3 years in ns is about 5e20, past 64 bits
+    long long expected = 0;
+    for (int i = 0; i < vehicles; ++i) {
+        lane.addVehicle(static_cast<VehicleHandle>(i), clock.now());
+        clock.waitFor(std::chrono::nanoseconds(1237));
+    }
+    for (int i = 0; i < vehicles; ++i) expected += 1237LL * (vehicles - i);
+    check(lane.getTotalWaitTime().count() == expected, "total wait is exact to the nanosecond three years in");
+    check(std::abs(lane.getAverageWaitTime() - expected / 1e9 / vehicles) < 1e-12, "average wait keeps sub-microsecond waits");
+
+    // Emptying the lane moves the base, so a later queue is just as exact
+    while (lane.hasVehicles()) lane.processVehicle();
+    clock.waitFor(std::chrono::hours(24 * 365));
+    lane.addVehicle(0, clock.now());
+    clock.waitFor(std::chrono::nanoseconds(1));
+    check(lane.getTotalWaitTime().count() == 1, "a one-nanosecond wait a year later");
+}
+
+// Every slot of the queue against a shadow deque
+static bool sameContents(const VehicleQueue& q, const std::deque<std::pair<VehicleHandle, long long>>& expected) {
+    if (q.size() != expected.size()) return false;
+    for (std::size_t i = 0; i < expected.size(); ++i)
+        if (q.handleAt(i) != expected[i].first || q.arrivalAt(i) != expected[i].second || q.emergencyAt(i) != (expected[i].first % 3 == 0))
+            return false;
+    return true;
+}
+
+static void queueWrapsAround() {
+    VehicleQueue q;
+    check(q.capacity() == 0, "an unused queue allocates nothing");
+    std::deque<std::pair<VehicleHandle, long long>> expected;
+    VehicleHandle next = 0;
+    bool ok = true;
+    // Hold 10 vehicles in 16 slots while the head goes round many times
+    for (int i = 0; i < 200; ++i) {
+        while (expected.size() < 10) {
+            q.push(next, next * 7LL, next % 3 == 0);
+            expected.emplace_back(next, next * 7LL);
+            ++next;
+        }
+        q.pop();
+        expected.pop_front();
+        ok &= sameContents(q, expected);
+    }
+    check(ok, "pushes and pops keep order across the wrap");
+    check(q.capacity() == 16, "a queue that never holds more than 16 does not grow");
+}
+
+static void queueGrowsWhileWrapped() {
+    VehicleQueue q;
+    std::deque<std::pair<VehicleHandle, long long>> expected;
+    VehicleHandle next = 0;
+    auto push = [&] {
+        q.push(next, -static_cast<long long>(next), next % 3 == 0);
+        expected.emplace_back(next, -static_cast<long long>(next));
+        ++next;
+    };
+    for (int i = 0; i < 12; ++i) push();
+    for (int i = 0; i < 9; ++i) {
+        q.pop();
+        expected.pop_front();
+    }
+    // The head is now part-way round, so growing has to unroll the ring
+    for (int i = 0; i < 1000; ++i) push();
+    check(sameContents(q, expected), "contents survive growth from a wrapped ring");
+    std::size_t capacity = q.capacity();
+    check(capacity >= q.size() && (capacity & (capacity - 1)) == 0, "capacity is a power of two that holds the queue");
+    while (!expected.empty()) {
+        q.pop();
+        expected.pop_front();
+    }
+    check(q.empty() && q.capacity() == capacity, "draining keeps the storage");
+}
+
+int main() {
+    return runTests({
+        { "aggregates match a scan", aggregatesMatchScan },
+        { "average wait is per vehicle", averageWaitIsPerVehicle },
+        { "emergency count follows departures", emergencyCountFollowsDepartures },
+        { "wait is exact late in a run", waitIsExactLateInARun },
+        { "queue wraps around", queueWrapsAround },
+        { "queue grows while wrapped", queueGrowsWhileWrapped },
+    });
+}
@@ -0,0 +1,79 @@
+// Metrics endpoint: scrapes over loopback, and a scraper that stops reading does not
+// hold the server thread
+
+#include "check.h"
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// A connected socket to the server on 127.0.0.1, or -1
+static int connectLocal(int port, int receiveBuffer = 0) {
+    int s = socket(AF_INET, SOCK_STREAM, 0);
+    if (receiveBuffer) setsockopt(s, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, sizeof receiveBuffer);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<std::uint16_t>(port));
+    inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    if (connect(s, reinterpret_cast<sockaddr*>(&address), sizeof address) != 0) {
+        close(s);
+        return -1;
+    }
+    return s;
+}
+
+static std::string get(int port, const std::string& target) {
+    int s = connectLocal(port);
+    if (s < 0) return "";
+    std::string request = "GET " + target + " HTTP/1.0\r\n\r\n", response;
+    send(s, request.data(), request.size(), 0);
+    char buffer[4096];
+    for (ssize_t n; (n = recv(s, buffer, sizeof buffer, 0)) > 0;) response.append(buffer, n);
+    close(s);
+    return response;
+}
+
+static void scrapesOverLoopback() {
+    MetricsServer server(0, [](std::ostream& os) { os << "tlc_test_value 42\n"; });
+    check(server.port() > 0, "port 0 picks a free port");
+    std::string response = get(server.port(), "/metrics");
+    check(response.rfind("HTTP/1.0 200 OK\r\n", 0) == 0, "GET /metrics succeeds");
+    check(response.find("\r\n\r\ntlc_test_value 42\n") != std::string::npos, "the body is the exporter's text");
+    check(get(server.port(), "/other").rfind("HTTP/1.0 404", 0) == 0, "other paths are not found");
+    check(server.getScrapeCount() == 1, "only the metrics scrape counts");
+}
+
+// The first scraper asks for far more than the socket buffers hold and never reads it;
+// the send gives up on its deadline and the next scraper is answered
+static void stalledScraperTimesOut() {
+    std::string big(16 << 20, 'x');
+    MetricsServer server(0, [&](std::ostream& os) { os << big; });
+    int stalled = connectLocal(server.port(), 4096);
+    check(stalled >= 0, "the stalled scraper connects");
+    std::string request = "GET /metrics HTTP/1.0\r\n\r\n";
+    send(stalled, request.data(), request.size(), 0);
+
+    auto start = std::chrono::steady_clock::now();
+    std::string response = get(server.port(), "/other");
+    double waited = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    check(response.rfind("HTTP/1.0 404", 0) == 0, "the next scraper is answered");
+    check(waited < 10, "within a few seconds of the stall");
+    close(stalled);
+}
+#endif
+
+static void rejectsBadAddress() {
+    checkThrows<std::invalid_argument>([] { MetricsServer server(0, [](std::ostream&) {}, "not-an-address"); }, "binding to a malformed address");
+}
+
+int main() {
+    return runTests({
+#ifndef _WIN32
+        { "scrapes over loopback", scrapesOverLoopback },
+        { "stalled scraper times out", stalledScraperTimesOut },
+#endif
+        { "rejects a bad address", rejectsBadAddress },
+    });
+}
@@ -0,0 +1,45 @@
+// Road networks: results must not depend on the worker thread count
+
+#include "check.h"
+
+// Short links with little storage, so departures are often refused and admission
+// decides who moves; that is where a thread-order dependence would show
+static RoadNetwork congestedGrid(int side) {
+    RoadNetwork net(3);
+    for (int i = 0; i < side * side; ++i) net.addIntersection();
+    auto at = [side](int r, int c) { return static_cast<std::size_t>(r * side + c); };
+    const auto travel = std::chrono::seconds(5);
+    for (int r = 0; r < side; ++r) {
+        for (int c = 0; c < side; ++c) {
+            if (r + 1 < side) net.addLink(at(r, c), SOUTH, at(r + 1, c), NORTH, travel, 12);
+            if (r > 0) net.addLink(at(r, c), NORTH, at(r - 1, c), SOUTH, travel, 12);
+            if (c > 0) net.addLink(at(r, c), WEST, at(r, c - 1), EAST, travel, 12);
+            if (c + 1 < side) net.addLink(at(r, c), EAST, at(r, c + 1), WEST, travel, 12);
+        }
+    }
+    for (std::size_t i = 0; i < net.intersectionCount(); ++i)
+        net.setDemandProfiles(i, std::vector<DemandProfile>(4, DemandProfile({ { 0, 400 } })));
+    return net;
+}
+
+static void gridIgnoresThreadCount() {
+    const auto hour = std::chrono::seconds(3600);
+    NetworkResult grid = runNetwork(RoadNetwork::grid(10, 10, 42), hour, 1);
+    check(grid.trips.vehicles > 0 && grid.trips.junctions > grid.trips.vehicles, "vehicles cross several junctions and leave");
+    for (unsigned threads : { 4u, 8u })
+        check(runNetwork(RoadNetwork::grid(10, 10, 42), hour, threads) == grid, "10x10 grid on " + std::to_string(threads) + " threads");
+}
+
+static void congestedGridIgnoresThreadCount() {
+    const auto hour = std::chrono::seconds(3600);
+    NetworkResult congested = runNetwork(congestedGrid(8), hour, 1);
+    for (unsigned threads : { 4u, 8u })
+        check(runNetwork(congestedGrid(8), hour, threads) == congested, "congested 8x8 grid on " + std::to_string(threads) + " threads");
+}
+
+int main() {
+    return runTests({
+        { "grid ignores thread count", gridIgnoresThreadCount },
+        { "congested grid ignores thread count", congestedGridIgnoresThreadCount },
+    });
+}
@@ -0,0 +1,62 @@
+// Pedestrian intervals against emergency preemption: an emergency that arrives during
+// WALK gets its green within the bound stated beside emergencyPreemption
+
+#include "check.h"
+
+// A junction fed only by the test: no random arrivals or crossing rolls. The long WALK
+// and short clearance make waiting out the interval easy to tell from cutting it short.
+static void quiet(EventRun<>& run) {
+    for (int a = 0; a < run.controller.getLayout().approaches(); ++a) run.controller.setExternalDemand(a, false);
+    run.controller.setSyntheticPedestrians(false);
+    run.controller.setEmergencyPreemption(true);
+    run.controller.setPedestrianTiming(PedestrianTiming{ 10, 2 });
+}
+
+static void arrive(EventRun<>& run, int approach, bool emergency) {
+    run.scheduler.scheduleAt(run.clock.now(), SENSOR_ARRIVAL, approach, 0, emergency, 0);
+}
+
+// One headway or the clearance, whichever is longer, then the cycle pause and the yellow
+static SimulationClock::duration preemptionBound(const IntersectionController& c) {
+    double seconds = std::max(c.getDischargeModel().saturationHeadwaySeconds, static_cast<double>(c.getPedestrianTiming().clearanceSeconds)) +
+        IntersectionController::cyclePauseMilliseconds / 1000.0 + c.getSignal().getYellowTime();
+    return std::chrono::duration_cast<SimulationClock::duration>(std::chrono::duration<double>(seconds));
+}
+
+// North queues `vehicles` with a crossing beside it; an emergency reaches east
+// `intoWalk` after the WALK comes on
+static void emergencyDuringWalk(int vehicles, std::chrono::seconds intoWalk) {
+    EventRun<> run(11);
+    quiet(run);
+    for (int i = 0; i < vehicles; ++i) arrive(run, NORTH, false);
+    run.controller.requestCrossing(NORTH);
+    run.start();
+    for (int step = 0; step < 600 && run.controller.getSignalSnapshot().pedestrian(NORTH) != WALK; ++step)
+        run.runUntil(run.clock.now() + std::chrono::milliseconds(100));
+    check(run.controller.getSignalSnapshot().pedestrian(NORTH) == WALK, "the crossing walks with north's green");
+
+    run.runFor(intoWalk);
+    arrive(run, EAST, true);
+    run.runUntil(run.clock.now());
+    check(run.controller.getSignalSnapshot().pedestrian(NORTH) == FLASHING_DONT_WALK, "the WALK goes straight to its clearance");
+    run.runFor(std::chrono::seconds(2));
+    check(run.controller.getSignalSnapshot().pedestrian(NORTH) == DONT_WALK, "the clearance still runs, and only that long");
+
+    run.runFor(std::chrono::seconds(60));
+    check(run.controller.getPreemptionCount() == 1, "the emergency preempted once");
+    check(run.controller.getMaxPreemptionLatency() > SimulationClock::duration::zero() &&
+          run.controller.getMaxPreemptionLatency() <= preemptionBound(run.controller), "the emergency's green comes within the bound");
+}
+
+// Vehicles are still crossing when the emergency arrives, so their headways end the green
+static void emergencyDuringWalkWithQueue() { emergencyDuringWalk(20, std::chrono::seconds(3)); }
+
+// The only vehicle has crossed, so the green was already waiting out the interval
+static void emergencyDuringWalkAfterQueue() { emergencyDuringWalk(1, std::chrono::seconds(5)); }
+
+int main() {
+    return runTests({
+        { "emergency during WALK with a queue", emergencyDuringWalkWithQueue },
+        { "emergency during WALK after the queue", emergencyDuringWalkAfterQueue },
+    });
+}
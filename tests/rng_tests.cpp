@@ -0,0 +1,71 @@
+// Seedable random streams: draws depend only on (seed, stream, counter)
+
+#include "check.h"
+
+#include <set>
+
+static void sameSeedSameDraws() {
+    RandomStream a(42, 3), b(42, 3);
+    bool same = true;
+    for (int i = 0; i < 1000; ++i) same &= a.next() == b.next();
+    check(same, "two streams with the same seed and id agree");
+    check(a.position() == 1000, "position counts draws");
+}
+
+static void streamsAreIndependent() {
+    RandomStream a(42, 0), b(42, 1), c(43, 0);
+    int matches = 0;
+    for (int i = 0; i < 1000; ++i) {
+        std::uint64_t x = a.next(), y = b.next(), z = c.next();
+        matches += (x == y) + (x == z);
+    }
+    check(matches == 0, "other stream ids and seeds draw other values");
+    check(RandomStream::deriveSeed(1, 0) != RandomStream::deriveSeed(1, 1), "derived seeds differ per index");
+}
+
+static void streamIdsAreDistinct() {
+    std::set<std::uint64_t> ids;
+    for (int kind : { STREAM_LANE, STREAM_PEDESTRIAN, STREAM_ARRIVAL })
+        for (int a = 0; a < maxApproaches; ++a) ids.insert(approachStreamId(static_cast<StreamKind>(kind), a));
+    check(ids.size() == 3 * maxApproaches, "every approach and kind has its own stream");
+}
+
+static void drawsAreInRange() {
+    RandomStream s(7);
+    std::array<int, 10> counts{};
+    double sum = 0;
+    bool inRange = true;
+    for (int i = 0; i < 100000; ++i) {
+        std::uint32_t k = s.below(10);
+        inRange &= k < 10;
+        if (k < 10) ++counts[k];
+        double u = s.uniform();
+        inRange &= u >= 0 && u < 1;
+        sum += u;
+    }
+    check(inRange, "below(n) and uniform() stay in range");
+    check(std::abs(sum / 100000 - 0.5) < 0.01, "uniform() has mean one half");
+    for (int c : counts) check(std::abs(c - 10000) < 600, "below(10) is close to uniform");
+}
+
+// A run is reproduced exactly by its seed, and nothing else feeds it randomness
+static void seedReproducesRun() {
+    EventRun<> a(5), b(5), c(6);
+    for (EventRun<>* r : { &a, &b, &c }) {
+        r->start();
+        r->runFor(std::chrono::seconds(1800));
+    }
+    check(a.controller.getTotalVehiclesProcessed() == b.controller.getTotalVehiclesProcessed() &&
+          a.controller.getTotalWaitTime() == b.controller.getTotalWaitTime(), "the same seed gives the same run");
+    check(a.controller.getTotalWaitTime() != c.controller.getTotalWaitTime(), "another seed gives another run");
+}
+
+int main() {
+    return runTests({
+        { "same seed, same draws", sameSeedSameDraws },
+        { "streams are independent", streamsAreIndependent },
+        { "stream ids are distinct", streamIdsAreDistinct },
+        { "draws are in range", drawsAreInRange },
+        { "seed reproduces a run", seedReproducesRun },
+    });
+}
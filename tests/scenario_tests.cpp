@@ -0,0 +1,18 @@
+// Scenarios: a precompiled scenario loads and runs exactly as its text form does
+
+#include "check.h"
+
+static void roundTrip() {
+    Scenario text = Scenario::load(TLC_REPO_DIR "/scenarios/rush-hour-grid.txt");
+    text.compile("rush-hour-grid.bin");
+    Scenario compiled = Scenario::load("rush-hour-grid.bin");
+    check(compiled.seed == text.seed && compiled.horizon == text.horizon && compiled.step == text.step, "scenario settings");
+    check(compiled.intersections.size() == text.intersections.size() && compiled.links.size() == text.links.size(), "scenario size");
+    check(runNetwork(compiled.build(), compiled.horizon, 1) == runNetwork(text.build(), text.horizon, 1), "precompiled scenario run");
+}
+
+int main() {
+    return runTests({
+        { "round trip", roundTrip },
+    });
+}
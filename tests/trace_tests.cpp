@@ -0,0 +1,68 @@
+// Binary traces: what the writer records is what the mapped reader replays, and a
+// failed write is an error rather than a short file
+
+#include "check.h"
+
+#include <fstream>
+
+static void recordsRoundTrip() {
+    {
+        TraceWriter writer("trace_round_trip.bin", 3, 7);    // a small buffer flushes many times
+        for (int i = 0; i < 100; ++i)
+            writer.write(TraceRecord{ i * 1000LL, i * 10LL, static_cast<std::uint32_t>(i / 8), i, TRACE_ARRIVAL, static_cast<std::uint8_t>(i % 3), 0,
+                                      static_cast<std::uint8_t>(i % 2), {} });
+        writer.close();
+        check(writer.records() == 100, "the writer counts its records");
+    }
+    TraceReader reader("trace_round_trip.bin");
+    check(reader.size() == 100 && reader.approaches() == 3, "the reader sees every record and the junction size");
+    bool same = true;
+    int i = 0;
+    for (const TraceRecord& r : reader) {
+        same &= r.time == i * 1000LL && r.arrivalTime == i * 10LL && r.vehicleId == i && r.approach == i % 3 && r.turn == i % 2;
+        ++i;
+    }
+    check(same, "records replay in order with their fields");
+}
+
+static void runIsTraced() {
+    EventRun<> run(9);
+    {
+        TraceWriter writer("trace_run.bin");
+        run.controller.setTraceWriter(&writer);
+        run.start();
+        run.runFor(std::chrono::seconds(600));
+        run.controller.setTraceWriter(nullptr);
+        writer.close();
+    }
+    TraceReader reader("trace_run.bin");
+    long long departures = 0;
+    for (const TraceRecord& r : reader) departures += r.type == TRACE_DEPARTURE;
+    check(departures == run.controller.getTotalVehiclesProcessed(), "every departure is traced");
+}
+
+static void rejectsOtherFiles() {
+    {
+        std::ofstream out("not_a_trace.bin", std::ios::binary);
+        out << "definitely not a trace header";
+    }
+    checkThrows<std::runtime_error>([] { TraceReader reader("not_a_trace.bin"); }, "reading a file without the trace magic");
+}
+
+#ifdef __linux__
+// /dev/full takes the open and fails every write with ENOSPC
+static void fullDiskThrows() {
+    checkThrows<std::runtime_error>([] { TraceWriter writer("/dev/full"); }, "writing the header to a full disk");
+}
+#endif
+
+int main() {
+    return runTests({
+        { "records round trip", recordsRoundTrip },
+        { "a run is traced", runIsTraced },
+        { "rejects other files", rejectsOtherFiles },
+#ifdef __linux__
+        { "a full disk throws", fullDiskThrows },
+#endif
+    });
+}